@@ -85,6 +85,8 @@ static char *ngx_set_env(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_set_priority(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_set_cpu_affinity(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+static char *ngx_set_worker_numa(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_set_worker_processes(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 
@@ -168,6 +170,20 @@ static ngx_command_t  ngx_core_commands[] = {
       0,
       NULL },
 
+    { ngx_string("worker_numa"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_TAKE12,
+      ngx_set_worker_numa,
+      0,
+      0,
+      NULL },
+
+    { ngx_string("reuseport_cpu_steering"),
+      NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_core_conf_t, reuseport_cpu_steering),
+      NULL },
+
     { ngx_string("worker_rlimit_nofile"),
       NGX_MAIN_CONF|NGX_DIRECT_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_num_slot,
@@ -1190,6 +1206,9 @@ ngx_core_module_create_conf(ngx_cycle_t *cycle)
 
     ccf->worker_processes = NGX_CONF_UNSET;
     ccf->debug_points = NGX_CONF_UNSET;
+    ccf->reuseport_cpu_steering = NGX_CONF_UNSET;
+    ccf->numa = NGX_CONF_UNSET;
+    ccf->numa_shm = NGX_CONF_UNSET;
 
     ccf->rlimit_nofile = NGX_CONF_UNSET;
     ccf->rlimit_core = NGX_CONF_UNSET;
@@ -1212,12 +1231,19 @@ ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf)
 {
     ngx_core_conf_t  *ccf = conf;
 
+#if (NGX_HAVE_NUMA)
+    ngx_uint_t        i;
+#endif
+
     ngx_conf_init_value(ccf->daemon, 1);
     ngx_conf_init_value(ccf->master, 1);
     ngx_conf_init_msec_value(ccf->timer_resolution, 0);
 
     ngx_conf_init_value(ccf->worker_processes, 1);
     ngx_conf_init_value(ccf->debug_points, 0);
+    ngx_conf_init_value(ccf->reuseport_cpu_steering, 0);
+    ngx_conf_init_value(ccf->numa, 0);
+    ngx_conf_init_value(ccf->numa_shm, NGX_NUMA_SHM_DEFAULT);
 
 #if (NGX_HAVE_CPU_AFFINITY)
 
@@ -1231,6 +1257,72 @@ ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf)
                       "using last mask for remaining worker processes");
     }
 
+#endif
+
+#if (NGX_HAVE_NUMA)
+
+    if (ccf->numa || ccf->numa_shm != NGX_NUMA_SHM_DEFAULT) {
+
+        ccf->numa_nodes = ngx_palloc(cycle->pool,
+                                 NGX_NUMA_MAX_NODES * sizeof(ngx_numa_node_t));
+        if (ccf->numa_nodes == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ccf->numa_nnodes = ngx_numa_get_nodes(ccf->numa_nodes, cycle->log);
+
+        if (ccf->numa_nnodes == 0) {
+            ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                          "NUMA topology is not available, "
+                          "\"worker_numa\" ignored");
+            ccf->numa = 0;
+            ccf->numa_shm = NGX_NUMA_SHM_DEFAULT;
+        }
+    }
+
+    if (ccf->numa_shm >= 0) {
+
+        for (i = 0; i < ccf->numa_nnodes; i++) {
+            if (ccf->numa_nodes[i].id == (ngx_uint_t) ccf->numa_shm) {
+                break;
+            }
+        }
+
+        if (i == ccf->numa_nnodes) {
+            ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                          "NUMA node %i is not found", ccf->numa_shm);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    /* spread the workers over the nodes unless they are pinned explicitly */
+
+    if (ccf->numa && ccf->cpu_affinity == NULL) {
+
+        ccf->cpu_affinity = ngx_palloc(cycle->pool,
+                                    ccf->worker_processes * sizeof(uint64_t));
+        if (ccf->cpu_affinity == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ccf->cpu_affinity_n = ccf->worker_processes;
+
+        for (i = 0; i < ccf->cpu_affinity_n; i++) {
+            ccf->cpu_affinity[i] =
+                             ccf->numa_nodes[i % ccf->numa_nnodes].cpus;
+        }
+    }
+
+#endif
+
+#if !(NGX_HAVE_REUSEPORT_CBPF)
+
+    if (ccf->reuseport_cpu_steering) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "\"reuseport_cpu_steering\" is not supported "
+                      "on this platform, ignored");
+    }
+
 #endif
 
 
@@ -1539,6 +1631,72 @@ ngx_set_cpu_affinity(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_set_worker_numa(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+#if (NGX_HAVE_NUMA)
+    ngx_core_conf_t  *ccf = conf;
+
+    ngx_str_t        *value;
+
+    if (ccf->numa != NGX_CONF_UNSET) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "auto") == 0) {
+        ccf->numa = 1;
+
+    } else if (ngx_strcmp(value[1].data, "off") == 0) {
+        ccf->numa = 0;
+
+    } else {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (cf->args->nelts == 2) {
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[2].data, "shm=", 4) != 0) {
+        goto invalid;
+    }
+
+    if (ngx_strcmp(&value[2].data[4], "interleave") == 0) {
+        ccf->numa_shm = NGX_NUMA_SHM_INTERLEAVE;
+        return NGX_CONF_OK;
+    }
+
+    ccf->numa_shm = ngx_atoi(&value[2].data[4], value[2].len - 4);
+
+    if (ccf->numa_shm == NGX_ERROR
+        || ccf->numa_shm >= (ngx_int_t) NGX_NUMA_MAX_NODES)
+    {
+        goto invalid;
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &value[2]);
+    return NGX_CONF_ERROR;
+
+#else
+
+    ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                       "\"worker_numa\" is not supported "
+                       "on this platform, ignored");
+    return NGX_CONF_OK;
+
+#endif
+}
+
+
 uint64_t
 ngx_get_cpu_affinity(ngx_uint_t n)
 {
@@ -14,6 +14,10 @@ ngx_os_io_t  ngx_io;
 
 
 static void ngx_drain_connections(void);
+#if (NGX_HAVE_REUSEPORT_CBPF)
+static void ngx_attach_reuseport_steering(ngx_cycle_t *cycle,
+    ngx_listening_t *ls, ngx_core_conf_t *ccf);
+#endif
 
 
 ngx_listening_t *
@@ -220,6 +224,18 @@ ngx_set_inherited_sockets(ngx_cycle_t *cycle)
 
         olen = sizeof(int);
 
+        if (getsockopt(ls[i].fd, SOL_SOCKET, SO_TYPE, (void *) &ls[i].type,
+                       &olen)
+            == -1)
+        {
+            ngx_log_error(NGX_LOG_CRIT, cycle->log, ngx_socket_errno,
+                          "getsockopt(SO_TYPE) %V failed", &ls[i].addr_text);
+            ls[i].ignore = 1;
+            continue;
+        }
+
+        olen = sizeof(int);
+
         if (getsockopt(ls[i].fd, SOL_SOCKET, SO_RCVBUF, (void *) &ls[i].rcvbuf,
                        &olen)
             == -1)
@@ -626,6 +642,11 @@ ngx_open_listening_sockets(ngx_cycle_t *cycle)
             }
 #endif
 
+            if (ls[i].type != SOCK_STREAM) {
+                ls[i].fd = s;
+                continue;
+            }
+
             /*
              * 绑定完套接字后就可以将该socket描述符变成监听状态了
              */
@@ -708,6 +729,11 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
 #if (NGX_HAVE_DEFERRED_ACCEPT && defined SO_ACCEPTFILTER)
     struct accept_filter_arg   af;
 #endif
+#if (NGX_HAVE_REUSEPORT_CBPF)
+    ngx_core_conf_t           *ccf;
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+#endif
 
     // 遍历所有的监听连接
     ls = cycle->listening.elts;
@@ -821,6 +847,15 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
         }
 #endif
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+        if (ls[i].reuseport && ls[i].worker == 0
+            && ccf->reuseport_cpu_steering
+            && ccf->worker_processes > 1)
+        {
+            ngx_attach_reuseport_steering(cycle, &ls[i], ccf);
+        }
+#endif
+
 #if (NGX_HAVE_TCP_FASTOPEN)
         if (ls[i].fastopen != -1) {
             if (setsockopt(ls[i].fd, IPPROTO_TCP, TCP_FASTOPEN,
@@ -962,6 +997,132 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle)
 }
 
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+
+/* ngx_get_cpu_affinity() looks at ngx_cycle, not yet this one */
+
+#define ngx_reuseport_worker_mask(ccf, worker)                                \
+    (ccf)->cpu_affinity[ngx_min(worker, (ccf)->cpu_affinity_n - 1)]
+
+
+static void
+ngx_attach_reuseport_steering(ngx_cycle_t *cycle, ngx_listening_t *ls,
+    ngx_core_conf_t *ccf)
+{
+    uint64_t             bit;
+    ngx_int_t            owner[64];
+    ngx_uint_t           cpu, worker, n, k, next;
+    struct sock_fprog    prog;
+    struct sock_filter   code[1 + 64 * 2 + 2], *pc;
+
+    /*
+     * the sockets of a reuseport group are indexed by the kernel in
+     * the order they were opened, that is, by ls->worker; the program
+     * returns the worker pinned to the CPU which received the packet,
+     * other CPUs are spread over the workers by modulo
+     */
+
+    pc = code;
+
+    *pc++ = (struct sock_filter)
+                BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+
+    /* a single mask shared by all workers does not tell them apart */
+
+    if (ccf->cpu_affinity_n > 1) {
+
+        /*
+         * a CPU in the masks of several workers, as with overlapping
+         * worker_cpu_affinity masks or worker_numa node masks, is given
+         * to them in turn
+         */
+
+        next = 0;
+
+        for (cpu = 0; cpu < 64; cpu++) {
+            owner[cpu] = -1;
+            bit = (uint64_t) 1 << cpu;
+
+            n = 0;
+
+            for (worker = 0; worker < (ngx_uint_t) ccf->worker_processes;
+                 worker++)
+            {
+                if (ngx_reuseport_worker_mask(ccf, worker) & bit) {
+                    n++;
+                }
+            }
+
+            if (n == 0) {
+                continue;
+            }
+
+            k = next++ % n;
+
+            for (worker = 0; /* void */ ; worker++) {
+                if ((ngx_reuseport_worker_mask(ccf, worker) & bit)
+                    && k-- == 0)
+                {
+                    owner[cpu] = worker;
+                    break;
+                }
+            }
+        }
+
+        /* a worker without a CPU would never get a connection */
+
+        for (worker = 0; worker < (ngx_uint_t) ccf->worker_processes; worker++)
+        {
+            for (cpu = 0; cpu < 64; cpu++) {
+                if (owner[cpu] == (ngx_int_t) worker) {
+                    break;
+                }
+            }
+
+            if (cpu == 64) {
+                ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                              "worker process %ui is left without a CPU, "
+                              "\"reuseport_cpu_steering\" on %V ignored",
+                              worker, &ls->addr_text);
+                return;
+            }
+        }
+
+        for (cpu = 0; cpu < 64; cpu++) {
+            if (owner[cpu] != -1) {
+                *pc++ = (struct sock_filter)
+                            BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, cpu, 0, 1);
+                *pc++ = (struct sock_filter)
+                            BPF_STMT(BPF_RET|BPF_K, owner[cpu]);
+            }
+        }
+    }
+
+    *pc++ = (struct sock_filter)
+                BPF_STMT(BPF_ALU|BPF_MOD|BPF_K, ccf->worker_processes);
+    *pc++ = (struct sock_filter) BPF_STMT(BPF_RET|BPF_A, 0);
+
+    prog.len = (unsigned short) (pc - code);
+    prog.filter = code;
+
+    if (setsockopt(ls->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                   (const void *) &prog, sizeof(struct sock_fprog))
+        == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                      "setsockopt(SO_ATTACH_REUSEPORT_CBPF) %V failed, "
+                      "ignored", &ls->addr_text);
+        return;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                   "reuseport steering on %V: %d instructions",
+                   &ls->addr_text, (int) prog.len);
+}
+
+#endif
+
+
 void
 ngx_close_listening_sockets(ngx_cycle_t *cycle)
 {
@@ -981,6 +1142,12 @@ ngx_close_listening_sockets(ngx_cycle_t *cycle)
 
         c = ls[i].connection;
 
+#if !(NGX_WIN32)
+        if (c && ls[i].type == SOCK_DGRAM) {
+            ngx_close_udp_sessions(&ls[i]);
+        }
+#endif
+
         if (c) {
             if (c->read->active) {
                 if (ngx_event_flags & NGX_USE_EPOLL_EVENT) {
@@ -1080,7 +1247,7 @@ ngx_get_connection(ngx_socket_t s, ngx_log_t *log)
     // 空闲连接个数减一
     ngx_cycle->free_connection_n--;
 
-    if (ngx_cycle->files) {
+    if (ngx_cycle->files && ngx_cycle->files[s] == NULL) {
         ngx_cycle->files[s] = c;
     }
 
@@ -1143,7 +1310,7 @@ ngx_free_connection(ngx_connection_t *c)
     ngx_cycle->free_connections = c;
     ngx_cycle->free_connection_n++;
 
-    if (ngx_cycle->files) {
+    if (ngx_cycle->files && ngx_cycle->files[c->fd] == c) {
         ngx_cycle->files[c->fd] = NULL;
     }
 }
@@ -1208,6 +1375,10 @@ ngx_close_connection(ngx_connection_t *c)
     fd = c->fd;
     c->fd = (ngx_socket_t) -1;
 
+    if (c->shared) {
+        return;
+    }
+
     if (ngx_close_socket(fd) == -1) {
 
         err = ngx_socket_errno;
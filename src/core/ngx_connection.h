@@ -72,6 +72,15 @@ struct ngx_listening_s {
     /* should be here because of the deferred accept */
     ngx_msec_t          post_accept_timeout;
 
+    /*
+     * per worker accounting of the listen queue,
+     * reported only in the "accept queue is full" warning
+     */
+    ngx_uint_t          accepted;
+    ngx_uint_t          dropped;
+    ngx_uint_t          overflows;
+    time_t              overflow_time;
+
     /*
      * 指向老的监听连接
      *
@@ -83,6 +92,10 @@ struct ngx_listening_s {
     ngx_listening_t    *previous;
     ngx_connection_t   *connection;
 
+    /* udp sessions keyed by the client address */
+    ngx_rbtree_t        rbtree;
+    ngx_rbtree_node_t   sentinel;
+
     // 当前worker编号,启动worker时给出
     ngx_uint_t          worker;
 
@@ -175,6 +188,7 @@ struct ngx_connection_s {
     ngx_event_t        *write;
 
     ngx_socket_t        fd;
+    int                 type;
 
     ngx_recv_pt         recv;
     ngx_send_pt         send;
@@ -211,6 +225,8 @@ struct ngx_connection_s {
 
     ngx_buf_t          *buffer;
 
+    ngx_udp_session_t  *udp;
+
     ngx_queue_t         queue;
 
     ngx_atomic_uint_t   number;
@@ -229,6 +245,7 @@ struct ngx_connection_s {
     unsigned            idle:1;
     unsigned            reusable:1;
     unsigned            close:1;
+    unsigned            shared:1;
 
     /*
      * 如果操作系统支持sendfile()方法,并且ngx支持sendfile指令,则该值为1
@@ -24,6 +24,7 @@ typedef struct ngx_file_s        ngx_file_t;
 typedef struct ngx_event_s       ngx_event_t;
 typedef struct ngx_event_aio_s   ngx_event_aio_t;
 typedef struct ngx_connection_s  ngx_connection_t;
+typedef struct ngx_udp_session_s  ngx_udp_session_t;
 
 #if (NGX_THREADS)
 typedef struct ngx_thread_task_s  ngx_thread_task_t;
@@ -100,6 +101,7 @@ typedef void (*ngx_connection_handler_pt)(ngx_connection_t *c);
 #include <ngx_regex.h>
 #endif
 #include <ngx_radix_tree.h>
+#include <ngx_trie.h>
 #include <ngx_times.h>
 #include <ngx_rwlock.h>
 #include <ngx_shmtx.h>
@@ -117,6 +119,7 @@ typedef void (*ngx_connection_handler_pt)(ngx_connection_t *c);
 #include <ngx_connection.h>
 #include <ngx_syslog.h>
 #include <ngx_proxy_protocol.h>
+#include <ngx_log_aggregate.h>
 
 
 #define LF     (u_char) '\n'
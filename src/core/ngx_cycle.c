@@ -673,6 +673,14 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
             goto failed;
         }
 
+#if (NGX_HAVE_NUMA)
+        if (ccf->numa_shm != NGX_NUMA_SHM_DEFAULT) {
+            ngx_numa_mbind(shm_zone[i].shm.addr, shm_zone[i].shm.size,
+                           ccf->numa_shm, ccf->numa_nodes, ccf->numa_nnodes,
+                           log);
+        }
+#endif
+
         /*
          * 将每个共享内存的开始一段内存初始化成ngx_slab_pool_t结构体
          *    sp = (ngx_slab_pool_t *) zn->shm.addr;
@@ -732,6 +740,10 @@ ngx_init_cycle(ngx_cycle_t *old_cycle)
                     continue;
                 }
 
+                if (ls[i].type != nls[n].type) {
+                    continue;
+                }
+
                 // 比较新老内核socket地址是否代表的链接相同
                 if (ngx_cmp_sockaddr(nls[n].sockaddr, nls[n].socklen,
                                      ls[i].sockaddr, ls[i].socklen, 1)
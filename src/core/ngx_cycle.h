@@ -192,6 +192,15 @@ typedef struct {
      ngx_uint_t               cpu_affinity_n;
      uint64_t                *cpu_affinity;
 
+     ngx_flag_t               reuseport_cpu_steering;
+
+     ngx_flag_t               numa;
+     ngx_int_t                numa_shm;
+#if (NGX_HAVE_NUMA)
+     ngx_uint_t               numa_nnodes;
+     ngx_numa_node_t         *numa_nodes;
+#endif
+
      char                    *username;
      ngx_uid_t                user;
      ngx_gid_t                group;
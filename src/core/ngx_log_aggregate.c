@@ -0,0 +1,93 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+void *
+ngx_log_aggregate_node(ngx_log_aggregate_keys_t *keys, ngx_str_t *key)
+{
+    u_char                    *p;
+    uint32_t                   hash;
+    ngx_log_aggregate_node_t  *node;
+
+    if (keys->pool == NULL) {
+        keys->pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_cycle->log);
+        if (keys->pool == NULL) {
+            return NULL;
+        }
+
+        ngx_rbtree_init(&keys->rbtree, &keys->sentinel,
+                        ngx_str_rbtree_insert_value);
+        ngx_queue_init(&keys->queue);
+
+        keys->overflow = NULL;
+        keys->nkeys = 0;
+    }
+
+    hash = ngx_crc32_long(key->data, key->len);
+
+    node = (ngx_log_aggregate_node_t *)
+               ngx_str_rbtree_lookup(&keys->rbtree, key, hash);
+
+    if (node) {
+        return node;
+    }
+
+    if (keys->nkeys == keys->max_keys) {
+
+        if (keys->overflow == NULL) {
+            node = ngx_pcalloc(keys->pool, keys->size + 1);
+            if (node == NULL) {
+                return NULL;
+            }
+
+            p = (u_char *) node + keys->size;
+            *p = '-';
+
+            node->sn.str.len = 1;
+            node->sn.str.data = p;
+
+            /* no keys are added after it, so it is written last */
+
+            ngx_queue_insert_tail(&keys->queue, &node->queue);
+
+            keys->overflow = node;
+        }
+
+        return keys->overflow;
+    }
+
+    node = ngx_pcalloc(keys->pool, keys->size + key->len);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    p = (u_char *) node + keys->size;
+    ngx_memcpy(p, key->data, key->len);
+
+    node->sn.node.key = hash;
+    node->sn.str.len = key->len;
+    node->sn.str.data = p;
+
+    ngx_rbtree_insert(&keys->rbtree, &node->sn.node);
+    ngx_queue_insert_tail(&keys->queue, &node->queue);
+
+    keys->nkeys++;
+
+    return node;
+}
+
+
+void
+ngx_log_aggregate_reset(ngx_log_aggregate_keys_t *keys)
+{
+    if (keys->pool) {
+        ngx_destroy_pool(keys->pool);
+        keys->pool = NULL;
+    }
+}
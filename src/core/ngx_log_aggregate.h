@@ -0,0 +1,47 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_LOG_AGGREGATE_H_INCLUDED_
+#define _NGX_LOG_AGGREGATE_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/*
+ * Per-interval counters grouped by a key, kept by a worker process in
+ * a pool which is destroyed when the counters are written out.  At most
+ * max_keys keys are tracked in an interval, the counters of other keys
+ * go to a single overflow node with the key "-".
+ */
+
+#define NGX_LOG_AGGREGATE_KEYS  10000
+
+
+typedef struct {
+    ngx_str_node_t                sn;
+    ngx_queue_t                   queue;
+} ngx_log_aggregate_node_t;
+
+
+typedef struct {
+    ngx_pool_t                   *pool;
+    ngx_rbtree_t                  rbtree;
+    ngx_rbtree_node_t             sentinel;
+    ngx_queue_t                   queue;      /* of ngx_log_aggregate_node_t */
+    ngx_log_aggregate_node_t     *overflow;
+    ngx_uint_t                    nkeys;
+    ngx_uint_t                    max_keys;
+    size_t                        size;       /* of a caller's node */
+} ngx_log_aggregate_keys_t;
+
+
+void *ngx_log_aggregate_node(ngx_log_aggregate_keys_t *keys, ngx_str_t *key);
+void ngx_log_aggregate_reset(ngx_log_aggregate_keys_t *keys);
+
+
+#endif /* _NGX_LOG_AGGREGATE_H_INCLUDED_ */
@@ -14,6 +14,9 @@ typedef struct {
 } ngx_regex_conf_t;
 
 
+#if (NGX_REGEX_SET)
+static ngx_int_t ngx_regex_set_check(ngx_str_t *pattern);
+#endif
 static void * ngx_libc_cdecl ngx_regex_malloc(size_t size);
 static void ngx_libc_cdecl ngx_regex_free(void *p);
 #if (NGX_HAVE_PCRE_JIT)
@@ -227,6 +230,211 @@ ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log)
 }
 
 
+#if (NGX_REGEX_SET)
+
+/*
+ * A regex set is a single pattern made of the alternation
+ * "(?:re0)(*MARK:0)|(?:re1)(*MARK:1)|...", so one pcre_exec() call
+ * either proves that none of the regexes match or reports the first
+ * of them that matches at the leftmost matching position.  A regex
+ * listed before it may still match further in the subject, unless it
+ * is anchored, so callers test only the non-anchored ones before the
+ * reported index.
+ */
+
+ngx_regex_set_t *
+ngx_regex_set_compile(ngx_pool_t *pool, ngx_regex_t **regexes,
+    ngx_str_t *patterns, ngx_uint_t n)
+{
+    u_char               *p, errstr[NGX_MAX_CONF_ERRSTR];
+    size_t                len;
+    ngx_uint_t            i;
+    unsigned long         options;
+    ngx_regex_set_t      *set;
+    ngx_regex_compile_t   rc;
+
+    len = 0;
+
+    for (i = 0; i < n; i++) {
+        if (ngx_regex_set_check(&patterns[i]) != NGX_OK) {
+            return NULL;
+        }
+
+        len += sizeof("|(?i:)(*MARK:)") - 1 + patterns[i].len + NGX_INT_T_LEN;
+    }
+
+    set = ngx_palloc(pool, sizeof(ngx_regex_set_t));
+    if (set == NULL) {
+        return NULL;
+    }
+
+    set->anchored = ngx_pnalloc(pool, n);
+    if (set->anchored == NULL) {
+        return NULL;
+    }
+
+    ngx_memzero(&rc, sizeof(ngx_regex_compile_t));
+
+    rc.pattern.data = ngx_pnalloc(pool, len + 1);
+    if (rc.pattern.data == NULL) {
+        return NULL;
+    }
+
+    p = rc.pattern.data;
+
+    for (i = 0; i < n; i++) {
+
+        if (pcre_fullinfo(regexes[i]->code, NULL, PCRE_INFO_OPTIONS, &options)
+            != 0)
+        {
+            return NULL;
+        }
+
+        set->anchored[i] = (options & PCRE_ANCHORED) ? 1 : 0;
+
+        if (i) {
+            *p++ = '|';
+        }
+
+        p = ngx_sprintf(p, (options & PCRE_CASELESS) ? "(?i:%V)(*MARK:%ui)"
+                                                     : "(?:%V)(*MARK:%ui)",
+                        &patterns[i], i);
+    }
+
+    *p = '\0';
+
+    rc.pattern.len = p - rc.pattern.data;
+    rc.pool = pool;
+    rc.options = PCRE_DUPNAMES;
+    rc.err.len = NGX_MAX_CONF_ERRSTR;
+    rc.err.data = errstr;
+
+    if (ngx_regex_compile(&rc) != NGX_OK) {
+        return NULL;
+    }
+
+    set->regex = rc.regex;
+    set->nelts = n;
+
+    return set;
+}
+
+
+ngx_int_t
+ngx_regex_set_exec(ngx_regex_set_t *set, ngx_str_t *s)
+{
+    int          rc;
+    u_char      *mark;
+    ngx_int_t    n;
+    pcre_extra   extra;
+
+    if (set->regex->extra) {
+        extra = *set->regex->extra;
+
+    } else {
+        ngx_memzero(&extra, sizeof(pcre_extra));
+    }
+
+    mark = NULL;
+
+    extra.flags |= PCRE_EXTRA_MARK;
+    extra.mark = &mark;
+
+    rc = pcre_exec(set->regex->code, &extra, (const char *) s->data, s->len,
+                   0, 0, NULL, 0);
+
+    if (rc == NGX_REGEX_NO_MATCHED) {
+        return NGX_DECLINED;
+    }
+
+    /* on errors the caller falls back to testing all regexes one by one */
+
+    if (rc < 0 || mark == NULL) {
+        return 0;
+    }
+
+    n = ngx_atoi(mark, ngx_strlen(mark));
+
+    if (n == NGX_ERROR || (ngx_uint_t) n >= set->nelts) {
+        return 0;
+    }
+
+    return n;
+}
+
+
+/*
+ * back references, recursion, conditions and backtracking control verbs
+ * change their meaning inside the combined pattern, as well as comments
+ * in the extended mode
+ */
+
+static ngx_int_t
+ngx_regex_set_check(ngx_str_t *pattern)
+{
+    u_char  *p, *last;
+
+    p = pattern->data;
+    last = p + pattern->len;
+
+    while (p < last) {
+
+        if (*p == '\\') {
+            p++;
+
+            if (p == last
+                || (*p >= '1' && *p <= '9') || *p == 'g' || *p == 'k')
+            {
+                return NGX_DECLINED;
+            }
+
+            p++;
+            continue;
+        }
+
+        if (*p++ != '(' || p == last) {
+            continue;
+        }
+
+        if (*p == '*') {
+            return NGX_DECLINED;
+        }
+
+        if (*p++ != '?' || p == last) {
+            continue;
+        }
+
+        if (*p == 'R' || *p == '&' || *p == '(' || *p == '+'
+            || (*p >= '0' && *p <= '9'))
+        {
+            return NGX_DECLINED;
+        }
+
+        if (last - p > 1
+            && ((*p == '-' && p[1] >= '0' && p[1] <= '9')
+                || (*p == 'P' && (p[1] == '=' || p[1] == '>'))))
+        {
+            return NGX_DECLINED;
+        }
+
+        while (p < last
+               && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')
+                   || *p == '-'))
+        {
+            if (*p == 'x') {
+                return NGX_DECLINED;
+            }
+
+            p++;
+        }
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
 static void * ngx_libc_cdecl
 ngx_regex_malloc(size_t size)
 {
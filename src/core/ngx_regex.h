@@ -19,6 +19,10 @@
 
 #define NGX_REGEX_CASELESS    PCRE_CASELESS
 
+#ifdef PCRE_EXTRA_MARK
+#define NGX_REGEX_SET         1
+#endif
+
 
 typedef struct {
     pcre        *code;
@@ -57,4 +61,23 @@ ngx_int_t ngx_regex_compile(ngx_regex_compile_t *rc);
 ngx_int_t ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log);
 
 
+#if (NGX_REGEX_SET)
+
+typedef struct {
+    ngx_regex_t  *regex;
+    u_char       *anchored;
+    ngx_uint_t    nelts;
+} ngx_regex_set_t;
+
+
+ngx_regex_set_t *ngx_regex_set_compile(ngx_pool_t *pool, ngx_regex_t **regexes,
+    ngx_str_t *patterns, ngx_uint_t n);
+ngx_int_t ngx_regex_set_exec(ngx_regex_set_t *set, ngx_str_t *s);
+
+#define ngx_regex_set_skip(set, i, n)                                        \
+    ((set) && (ngx_int_t) (i) < (n) && (set)->anchored[i])
+
+#endif
+
+
 #endif /* _NGX_REGEX_H_INCLUDED_ */
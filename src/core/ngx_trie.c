@@ -0,0 +1,242 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_TRIE_MAX_LABEL  0xffff
+
+
+typedef struct {
+    ngx_uint_t         lo;
+    ngx_uint_t         hi;
+    size_t             depth;
+} ngx_trie_range_t;
+
+
+/*
+ * the keys must be sorted with ngx_trie_cmp_keys() and must be unique,
+ * the values must not be NULL
+ */
+
+ngx_int_t
+ngx_trie_init(ngx_trie_t *trie, ngx_pool_t *pool, ngx_pool_t *temp_pool,
+    ngx_hash_key_t *keys, ngx_uint_t nelts)
+{
+    u_char            *p, c;
+    size_t             len, size, depth;
+    ngx_str_t         *first, *last;
+    ngx_uint_t         i, j, n, lo, hi, next;
+    ngx_trie_node_t   *node, *nodes;
+    ngx_trie_range_t  *ranges;
+
+    trie->nodes = NULL;
+    trie->first = NULL;
+    trie->nnodes = 0;
+
+    if (nelts == 0) {
+        return NGX_OK;
+    }
+
+    size = 0;
+
+    for (i = 0; i < nelts; i++) {
+        size += keys[i].key.len;
+    }
+
+    /*
+     * every key adds at most a leaf and a split node, and labels longer
+     * than NGX_TRIE_MAX_LABEL are chained through single-child nodes
+     */
+
+    n = 2 * nelts + size / NGX_TRIE_MAX_LABEL + 1;
+
+    ranges = ngx_palloc(temp_pool, n * sizeof(ngx_trie_range_t));
+    if (ranges == NULL) {
+        return NGX_ERROR;
+    }
+
+    nodes = ngx_palloc(temp_pool, n * sizeof(ngx_trie_node_t));
+    if (nodes == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = ngx_pnalloc(pool, size ? size : 1);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    ranges[0].lo = 0;
+    ranges[0].hi = nelts;
+    ranges[0].depth = 0;
+
+    next = 1;
+
+    for (i = 0; i < next; i++) {
+
+        lo = ranges[i].lo;
+        hi = ranges[i].hi;
+        depth = ranges[i].depth;
+
+        /*
+         * the keys are sorted, so the common prefix of the range
+         * is the common prefix of its first and last keys
+         */
+
+        first = &keys[lo].key;
+        last = &keys[hi - 1].key;
+
+        len = ngx_min(first->len, last->len) - depth;
+
+        if (len > NGX_TRIE_MAX_LABEL) {
+            len = NGX_TRIE_MAX_LABEL;
+        }
+
+        for (j = 0; j < len; j++) {
+            if (first->data[depth + j] != last->data[depth + j]) {
+                break;
+            }
+        }
+
+        len = j;
+
+        node = &nodes[i];
+
+        node->label = p;
+        node->len = (uint16_t) len;
+        node->value = NULL;
+        node->child = (uint32_t) next;
+        node->nchildren = 0;
+
+        p = ngx_cpymem(p, &first->data[depth], len);
+
+        depth += len;
+
+        if (first->len == depth) {
+            node->value = keys[lo].value;
+            lo++;
+
+            if (lo < hi && keys[lo].key.len == depth) {
+                return NGX_BUSY;
+            }
+        }
+
+        while (lo < hi) {
+            c = keys[lo].key.data[depth];
+
+            for (j = lo + 1; j < hi; j++) {
+                if (keys[j].key.data[depth] != c) {
+                    break;
+                }
+            }
+
+            ranges[next].lo = lo;
+            ranges[next].hi = j;
+            ranges[next].depth = depth;
+
+            next++;
+            node->nchildren++;
+
+            lo = j;
+        }
+    }
+
+    trie->nodes = ngx_palloc(pool, next * sizeof(ngx_trie_node_t));
+    if (trie->nodes == NULL) {
+        return NGX_ERROR;
+    }
+
+    trie->first = ngx_pnalloc(pool, next);
+    if (trie->first == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(trie->nodes, nodes, next * sizeof(ngx_trie_node_t));
+
+    trie->first[0] = '\0';
+
+    for (i = 1; i < next; i++) {
+        trie->first[i] = nodes[i].label[0];
+    }
+
+    trie->nnodes = next;
+
+    return NGX_OK;
+}
+
+
+/* returns the value of the longest key that is a prefix of the key */
+
+void *
+ngx_trie_find(ngx_trie_t *trie, u_char *key, size_t len)
+{
+    void             *value;
+    u_char           *first;
+    ngx_uint_t        lo, hi, mid;
+    ngx_trie_node_t  *node;
+
+    if (trie->nodes == NULL) {
+        return NULL;
+    }
+
+    value = NULL;
+    node = trie->nodes;
+
+    for ( ;; ) {
+
+        if (len < node->len || ngx_memcmp(key, node->label, node->len) != 0) {
+            return value;
+        }
+
+        key += node->len;
+        len -= node->len;
+
+        if (node->value) {
+            value = node->value;
+        }
+
+        if (len == 0 || node->nchildren == 0) {
+            return value;
+        }
+
+        first = &trie->first[node->child];
+
+        lo = 0;
+        hi = node->nchildren;
+
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+
+            if (first[mid] < *key) {
+                lo = mid + 1;
+
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo == node->nchildren || first[lo] != *key) {
+            return value;
+        }
+
+        node = &trie->nodes[node->child + lo];
+    }
+}
+
+
+int ngx_libc_cdecl
+ngx_trie_cmp_keys(const void *one, const void *two)
+{
+    ngx_hash_key_t  *first, *second;
+
+    first = (ngx_hash_key_t *) one;
+    second = (ngx_hash_key_t *) two;
+
+    return (int) ngx_memn2cmp(first->key.data, second->key.data,
+                              first->key.len, second->key.len);
+}
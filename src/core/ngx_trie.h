@@ -0,0 +1,45 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_TRIE_H_INCLUDED_
+#define _NGX_TRIE_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/*
+ * A read-only compressed prefix tree built once from a sorted array
+ * of keys.  The nodes are laid out breadth-first in a single array,
+ * so the children of a node are contiguous and may be selected by
+ * a binary search over their first label bytes.
+ */
+
+typedef struct {
+    void             *value;
+    u_char           *label;
+    uint32_t          child;
+    uint16_t          len;
+    uint16_t          nchildren;
+} ngx_trie_node_t;
+
+
+typedef struct {
+    ngx_trie_node_t  *nodes;
+    u_char           *first;
+    ngx_uint_t        nnodes;
+} ngx_trie_t;
+
+
+ngx_int_t ngx_trie_init(ngx_trie_t *trie, ngx_pool_t *pool,
+    ngx_pool_t *temp_pool, ngx_hash_key_t *keys, ngx_uint_t nelts);
+void *ngx_trie_find(ngx_trie_t *trie, u_char *key, size_t len);
+int ngx_libc_cdecl ngx_trie_cmp_keys(const void *one, const void *two);
+
+
+#endif /* _NGX_TRIE_H_INCLUDED_ */
@@ -28,6 +28,8 @@ static char *ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static char *ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_event_multi_accept(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_event_debug_connection(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 
@@ -180,8 +182,8 @@ static ngx_command_t  ngx_event_core_commands[] = {
       NULL },
 
     { ngx_string("multi_accept"),
-      NGX_EVENT_CONF|NGX_CONF_FLAG,
-      ngx_conf_set_flag_slot,
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_event_multi_accept,
       0,
       offsetof(ngx_event_conf_t, multi_accept),
       NULL },
@@ -621,6 +623,29 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     // 设置更新缓存时间的间隔时间
     ngx_timer_resolution = ccf->timer_resolution;
 
+#if !(NGX_WIN32 || NGX_HAVE_REUSEPORT)
+    {
+    ngx_uint_t        i;
+    ngx_listening_t  *ls;
+
+    /*
+     * udp sessions are kept per worker, a shared udp socket would spread
+     * datagrams of a client over several workers
+     */
+
+    ls = cycle->listening.elts;
+    for (i = 0; i < cycle->listening.nelts; i++) {
+        if (ls[i].type == SOCK_DGRAM && ccf->worker_processes > 1) {
+            ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                          "udp listen socket %V requires "
+                          "\"worker_processes 1\" on this platform",
+                          &ls[i].addr_text);
+            return NGX_ERROR;
+        }
+    }
+    }
+#endif
+
     //下面这段代码貌似只是为了打印日志,比如分配的ngx_connection_t个数大于当前进程允许打开的最大描述符个数
 #if !(NGX_WIN32)
     {
@@ -1091,6 +1116,7 @@ ngx_event_process_init(ngx_cycle_t *cycle)
             return NGX_ERROR;
         }
 
+        c->type = ls[i].type;
         c->log = &ls[i].log;
 
         // 连接对象(ngx_connection_t)中有监听对象(ngx_listening_t)
@@ -1174,7 +1200,15 @@ ngx_event_process_init(ngx_cycle_t *cycle)
          * 在初始化时设置的自己的方法,比如http核心模块的ngx_http_init_connection方法。
          *
          */
-        rev->handler = ngx_event_accept;
+        if (c->type == SOCK_STREAM) {
+            rev->handler = ngx_event_accept;
+
+        } else {
+            ngx_rbtree_init(&ls[i].rbtree, &ls[i].sentinel,
+                            ngx_udp_rbtree_insert_value);
+
+            rev->handler = ngx_event_recvmsg;
+        }
 
         // 检查是否使用互斥锁
         if (ngx_use_accept_mutex
@@ -1584,6 +1618,48 @@ ngx_event_use(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_event_multi_accept(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_event_conf_t  *ecf = conf;
+
+    ngx_int_t   n;
+    ngx_str_t  *value;
+
+    if (ecf->multi_accept != NGX_CONF_UNSET) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "on") == 0) {
+        ecf->multi_accept = NGX_EVENT_ACCEPT_ALL;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        ecf->multi_accept = 0;
+        return NGX_CONF_OK;
+    }
+
+    /* the number of connections accepted per a listen event */
+
+    n = ngx_atoi(value[1].data, value[1].len);
+
+    if (n == NGX_ERROR || n == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid value \"%V\" in \"%V\" directive, "
+                           "it must be \"on\", \"off\" or a number",
+                           &value[1], &cmd->name);
+        return NGX_CONF_ERROR;
+    }
+
+    ecf->multi_accept = (n == 1) ? 0 : n;
+
+    return NGX_CONF_OK;
+}
+
+
 /*
  * debug_connection指令对应的方法
  *
@@ -126,19 +126,11 @@ struct ngx_event_s {
      * iocp: TODO
      *
      * otherwise:
-     *   accept:     1 if accept many, 0 otherwise
+     *   accept:     number of sockets to accept in a batch,
+     *               NGX_EVENT_ACCEPT_ALL if accept many, 0 otherwise
      */
 
-#if (NGX_HAVE_KQUEUE) || (NGX_HAVE_IOCP)
     int              available;
-#else
-    /*
-     * 如果该事件是监听连接的接收事件则
-     * 表示是否尽量多的建立TCP连接
-     * 该值有multi_accept指令负责(on|off)
-     */
-    unsigned         available:1;
-#endif
 
     // 事件发生后要做的事
     ngx_event_handler_pt  handler;
@@ -500,8 +492,8 @@ typedef struct {
     // 使用哪种事件模块(epoll、select等),有use指令指定
     ngx_uint_t    use;
 
-    // 是否尽可能多的获取连接(on|off)
-    ngx_flag_t    multi_accept;
+    // 是否尽可能多的获取连接(on|off|number)
+    ngx_int_t     multi_accept;
     /**
      * 是否开启互斥锁,对应指令accept_mutex,默认on; 1.11.3之后默认是off
      * 如果开启,代表使用负载均衡机制
@@ -560,6 +552,10 @@ extern ngx_atomic_t  *ngx_stat_waiting;
 #endif
 
 
+/* must not collide with NGX_CONF_UNSET */
+#define NGX_EVENT_ACCEPT_ALL    NGX_MAX_INT32_VALUE
+
+
 #define NGX_UPDATE_TIME         1
 #define NGX_POST_EVENTS         2
 
@@ -601,6 +597,7 @@ ngx_int_t ngx_send_lowat(ngx_connection_t *c, size_t lowat);
 
 #include <ngx_event_timer.h>
 #include <ngx_event_posted.h>
+#include <ngx_event_udp.h>
 
 #if (NGX_WIN32)
 #include <ngx_iocp_module.h>
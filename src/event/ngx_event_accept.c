@@ -13,6 +13,7 @@
 static ngx_int_t ngx_enable_accept_events(ngx_cycle_t *cycle);
 static ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle, ngx_uint_t all);
 static void ngx_close_accepted_connection(ngx_connection_t *c);
+static void ngx_event_accept_check_queue(ngx_listening_t *ls, ngx_log_t *log);
 
 
 /**
@@ -132,6 +133,9 @@ ngx_event_accept(ngx_event_t *ev)
                 if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
                     // 如果使用KQUEUE事件模块则执行这个操作
                     ev->available--;
+
+                } else if (ev->available > 0) {
+                    ev->available--;
                 }
 
                 if (ev->available) {
@@ -191,6 +195,8 @@ ngx_event_accept(ngx_event_t *ev)
 
         // 没有多余的连接对象(ngx_connection_t)使用了,则直接关闭这个新建立的描述符
         if (c == NULL) {
+            ls->dropped++;
+
             if (ngx_close_socket(s) == -1) {
                 ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_socket_errno,
                               ngx_close_socket_n " failed");
@@ -257,6 +263,8 @@ ngx_event_accept(ngx_event_t *ev)
 
         *log = ls->log;
 
+        c->type = SOCK_STREAM;
+
         // 该连接上的读方法
         c->recv = ngx_recv;
         // 写方法
@@ -327,6 +335,8 @@ ngx_event_accept(ngx_event_t *ev)
         // 当前连接是第多少个连接,也可以表示从ngx启动到现在总共接收了多少个tcp
         c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
 
+        ls->accepted++;
+
 #if (NGX_STAT_STUB)
         (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
 #endif
@@ -446,6 +456,15 @@ ngx_event_accept(ngx_event_t *ev)
         if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
             // KQUEUE模块使用,epoll没用
             ev->available--;
+
+        } else if (ev->available > 0 && --ev->available == 0) {
+
+            /*
+             * the batch set by "multi_accept number" is exhausted,
+             * the rest of the queue is left for the next wakeup
+             */
+
+            ngx_event_accept_check_queue(ls, ev->log);
         }
 
        /*
@@ -456,6 +475,51 @@ ngx_event_accept(ngx_event_t *ev)
 }
 
 
+static void
+ngx_event_accept_check_queue(ngx_listening_t *ls, ngx_log_t *log)
+{
+#if (NGX_LINUX && NGX_HAVE_TCP_INFO)
+
+    socklen_t        len;
+    struct tcp_info  ti;
+
+    /*
+     * on a listen socket Linux reports the current length of
+     * the accept queue in tcpi_unacked and its limit in tcpi_sacked
+     */
+
+    len = sizeof(struct tcp_info);
+
+    if (getsockopt(ls->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == -1) {
+        return;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "accept queue on %V: %uD of %uD",
+                   &ls->addr_text, ti.tcpi_unacked, ti.tcpi_sacked);
+
+    if (ti.tcpi_sacked == 0 || ti.tcpi_unacked < ti.tcpi_sacked) {
+        return;
+    }
+
+    ls->overflows++;
+
+    if (ls->overflow_time == ngx_time()) {
+        return;
+    }
+
+    ls->overflow_time = ngx_time();
+
+    ngx_log_error(NGX_LOG_WARN, log, 0,
+                  "accept queue on %V is full: %uD of %uD, "
+                  "%ui overflows, %ui accepted, %ui dropped",
+                  &ls->addr_text, ti.tcpi_unacked, ti.tcpi_sacked,
+                  ls->overflows, ls->accepted, ls->dropped);
+
+#endif
+}
+
+
 /**
  * 试着去获取互斥锁,不管有没有获取到锁,都会返回NGX_OK
  * 如果发生错误则返回NGX_ERROR
@@ -127,6 +127,7 @@ struct ngx_peer_connection_s {
     ngx_addr_t                      *local;
 
     int                              rcvbuf;
+    int                              type;
 
     ngx_log_t                       *log;
 
@@ -12,6 +12,11 @@
 
 #define NGX_SSL_PASSWORD_BUFFER_SIZE  4096
 
+/* in-memory copies of file data keep in_file set and go via SSL_write() */
+
+#define ngx_ssl_sendfile_buf(c, b)                                            \
+    ((c)->ssl->sendfile && (b)->in_file && !ngx_buf_in_memory(b))
+
 
 typedef struct {
     ngx_uint_t  engine;   /* unsigned  engine:1; */
@@ -25,8 +30,15 @@ static void ngx_ssl_info_callback(const ngx_ssl_conn_t *ssl_conn, int where,
     int ret);
 static void ngx_ssl_passwords_cleanup(void *data);
 static void ngx_ssl_handshake_handler(ngx_event_t *ev);
+#ifdef SSL_MODE_ASYNC
+static ngx_int_t ngx_ssl_async_wait(ngx_connection_t *c, ngx_uint_t write);
+static void ngx_ssl_async_handler(ngx_event_t *ev);
+static void ngx_ssl_async_clear(ngx_connection_t *c);
+#endif
 static ngx_int_t ngx_ssl_handle_recv(ngx_connection_t *c, int n);
 static void ngx_ssl_write_handler(ngx_event_t *wev);
+static ssize_t ngx_ssl_sendfile(ngx_connection_t *c, ngx_buf_t *file,
+    size_t size);
 static void ngx_ssl_read_handler(ngx_event_t *rev);
 static void ngx_ssl_shutdown_handler(ngx_event_t *ev);
 static void ngx_ssl_connection_error(ngx_connection_t *c, int sslerr,
@@ -41,6 +53,16 @@ static int ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn,
 static ngx_ssl_session_t *ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn,
     u_char *id, int len, int *copy);
 static void ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess);
+static ngx_int_t ngx_ssl_session_cache_init_shards(ngx_shm_zone_t *shm_zone,
+    ngx_ssl_session_cache_t *cache, ngx_uint_t nshards);
+static ngx_ssl_sess_slot_t *ngx_ssl_session_bucket(
+    ngx_ssl_session_cache_t *cache, uint32_t hash,
+    ngx_ssl_session_shard_t **shard);
+static ngx_ssl_sess_slot_t *ngx_ssl_session_slot_find(
+    ngx_ssl_sess_slot_t *bucket, uint32_t hash, const u_char *id, size_t len);
+static void ngx_ssl_session_slot_store(ngx_ssl_session_cache_t *cache,
+    u_char *id, size_t id_len, u_char *buf, size_t len, time_t expire,
+    ngx_log_t *log);
 static void ngx_ssl_expire_sessions(ngx_ssl_session_cache_t *cache,
     ngx_slab_pool_t *shpool, ngx_uint_t n);
 static void ngx_ssl_session_rbtree_insert_value(ngx_rbtree_node_t *temp,
@@ -1037,6 +1059,7 @@ ngx_ssl_create_connection(ngx_ssl_t *ssl, ngx_connection_t *c, ngx_uint_t flags)
 
     sc->buffer = ((flags & NGX_SSL_BUFFER) != 0);
     sc->buffer_size = ssl->buffer_size;
+    sc->dyn_rec = ssl->dyn_rec;
 
     sc->connection = SSL_new(ssl->ctx);
 
@@ -1153,6 +1176,21 @@ ngx_ssl_handshake(ngx_connection_t *c)
 
         c->ssl->handshaked = 1;
 
+#ifdef SSL_MODE_ASYNC
+        ngx_ssl_async_clear(c);
+#endif
+
+#ifdef BIO_get_ktls_send
+
+        if (BIO_get_ktls_send(SSL_get_wbio(c->ssl->connection)) == 1) {
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "BIO_get_ktls_send(): 1");
+
+            c->ssl->sendfile = 1;
+        }
+
+#endif
+
         c->recv = ngx_ssl_recv;
         c->send = ngx_ssl_write;
         c->recv_chain = ngx_ssl_recv_chain;
@@ -1206,6 +1244,21 @@ ngx_ssl_handshake(ngx_connection_t *c)
         return NGX_AGAIN;
     }
 
+#ifdef SSL_MODE_ASYNC
+
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        c->read->handler = ngx_ssl_handshake_handler;
+        c->write->handler = ngx_ssl_handshake_handler;
+
+        if (ngx_ssl_async_wait(c, 0) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     err = (sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
 
     c->ssl->no_wait_shutdown = 1;
@@ -1250,6 +1303,116 @@ ngx_ssl_handshake_handler(ngx_event_t *ev)
 }
 
 
+#ifdef SSL_MODE_ASYNC
+
+/*
+ * An engine which performs private key operations asynchronously, e.g.
+ * in its own threads or on a hardware accelerator, pauses the SSL job
+ * and signals a wait fd when the job may be resumed.  The fd is watched
+ * with a separate connection, and the paused operation is retried from
+ * the read or write handler of the connection it was started from.
+ */
+
+static ngx_int_t
+ngx_ssl_async_wait(ngx_connection_t *c, ngx_uint_t write)
+{
+    size_t             n;
+    OSSL_ASYNC_FD      fd;
+    ngx_connection_t  *ac;
+
+    if (SSL_get_all_async_fds(c->ssl->connection, NULL, &n) == 0 || n != 1) {
+        ngx_ssl_error(NGX_LOG_ALERT, c->log, 0,
+                      "SSL_get_all_async_fds() failed");
+        return NGX_ERROR;
+    }
+
+    if (SSL_get_all_async_fds(c->ssl->connection, &fd, &n) == 0) {
+        ngx_ssl_error(NGX_LOG_ALERT, c->log, 0,
+                      "SSL_get_all_async_fds() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "SSL async wait fd:%d write:%ui", fd, write);
+
+    c->ssl->async_write = write;
+
+    ac = c->ssl->async;
+
+    if (ac && ac->fd == fd) {
+        return NGX_OK;
+    }
+
+    ngx_ssl_async_clear(c);
+
+    ac = ngx_get_connection(fd, c->log);
+    if (ac == NULL) {
+        return NGX_ERROR;
+    }
+
+    ac->data = c;
+    ac->read->handler = ngx_ssl_async_handler;
+    ac->read->log = c->log;
+    ac->write->log = c->log;
+
+    c->ssl->async = ac;
+
+    if (ngx_handle_read_event(ac->read, 0) != NGX_OK) {
+        ngx_ssl_async_clear(c);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_ssl_async_handler(ngx_event_t *ev)
+{
+    ngx_connection_t  *c, *ac;
+
+    ac = ev->data;
+    c = ac->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL async handler");
+
+    if (c->ssl->async_write) {
+        c->write->ready = 1;
+        c->write->handler(c->write);
+        return;
+    }
+
+    c->read->ready = 1;
+    c->read->handler(c->read);
+}
+
+
+static void
+ngx_ssl_async_clear(ngx_connection_t *c)
+{
+    ngx_connection_t  *ac;
+
+    ac = c->ssl->async;
+
+    if (ac == NULL) {
+        return;
+    }
+
+    c->ssl->async = NULL;
+
+    /* the fd belongs to the engine and is not closed here */
+
+    if (ac->read->active) {
+        (void) ngx_del_event(ac->read, NGX_READ_EVENT, 0);
+    }
+
+    ngx_free_connection(ac);
+    ac->fd = (ngx_socket_t) -1;
+}
+
+#endif
+
+
 ssize_t
 ngx_ssl_recv_chain(ngx_connection_t *c, ngx_chain_t *cl, off_t limit)
 {
@@ -1417,6 +1580,12 @@ ngx_ssl_handle_recv(ngx_connection_t *c, int n)
 
     if (n > 0) {
 
+#ifdef SSL_MODE_ASYNC
+        if (!c->ssl->async_write) {
+            ngx_ssl_async_clear(c);
+        }
+#endif
+
         if (c->ssl->saved_write_handler) {
 
             c->write->handler = c->ssl->saved_write_handler;
@@ -1444,6 +1613,20 @@ ngx_ssl_handle_recv(ngx_connection_t *c, int n)
         return NGX_AGAIN;
     }
 
+#ifdef SSL_MODE_ASYNC
+
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        c->read->ready = 0;
+
+        if (ngx_ssl_async_wait(c, 0) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     if (sslerr == SSL_ERROR_WANT_WRITE) {
 
         ngx_log_error(NGX_LOG_INFO, c->log, 0,
@@ -1505,18 +1688,60 @@ ngx_chain_t *
 ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 {
     int          n;
+    u_char      *end;
     ngx_uint_t   flush;
     ssize_t      send, size;
     ngx_buf_t   *buf;
 
+    /* the maximum limit size is the maximum int32_t value - the page size */
+
+    if (limit == 0 || limit > (off_t) (NGX_MAX_INT32_VALUE - ngx_pagesize)) {
+        limit = NGX_MAX_INT32_VALUE - ngx_pagesize;
+    }
+
     if (!c->ssl->buffer) {
 
+        send = 0;
+
         while (in) {
             if (ngx_buf_special(in->buf)) {
                 in = in->next;
                 continue;
             }
 
+            if (ngx_ssl_sendfile_buf(c, in->buf)) {
+
+                if (send == limit) {
+                    return in;
+                }
+
+                size = (ssize_t) ngx_min(in->buf->file_last - in->buf->file_pos,
+                                         limit - send);
+
+                n = ngx_ssl_sendfile(c, in->buf, size);
+
+                if (n == NGX_ERROR) {
+                    return NGX_CHAIN_ERROR;
+                }
+
+                if (n == NGX_AGAIN) {
+                    return in;
+                }
+
+                in->buf->file_pos += n;
+                send += n;
+
+                if (in->buf->file_pos == in->buf->file_last) {
+                    in = in->next;
+                }
+
+                if (n < size) {
+                    return in;
+                }
+
+                continue;
+            }
+
             n = ngx_ssl_write(c, in->buf->pos, in->buf->last - in->buf->pos);
 
             if (n == NGX_ERROR) {
@@ -1537,13 +1762,6 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
         return in;
     }
 
-
-    /* the maximum limit size is the maximum int32_t value - the page size */
-
-    if (limit == 0 || limit > (off_t) (NGX_MAX_INT32_VALUE - ngx_pagesize)) {
-        limit = NGX_MAX_INT32_VALUE - ngx_pagesize;
-    }
-
     buf = c->ssl->buf;
 
     if (buf == NULL) {
@@ -1569,9 +1787,26 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
     send = buf->last - buf->pos;
     flush = (in == NULL) ? 1 : buf->flush;
 
+    if (c->ssl->dyn_rec.timeout
+        && ngx_current_msec - c->ssl->dyn_rec_last_write
+           > c->ssl->dyn_rec.timeout)
+    {
+        /* after the handshake or an idle period start with small records */
+        c->ssl->dyn_rec_records = 0;
+    }
+
     for ( ;; ) {
 
-        while (in && buf->last < buf->end && send < limit) {
+        end = buf->end;
+
+        if (c->ssl->dyn_rec.timeout
+            && c->ssl->dyn_rec_records < c->ssl->dyn_rec.threshold
+            && (size_t) (buf->end - buf->start) > c->ssl->dyn_rec.size_lo)
+        {
+            end = buf->start + c->ssl->dyn_rec.size_lo;
+        }
+
+        while (in && buf->last < end && send < limit) {
             if (in->buf->last_buf || in->buf->flush) {
                 flush = 1;
             }
@@ -1581,10 +1816,15 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
                 continue;
             }
 
+            if (ngx_ssl_sendfile_buf(c, in->buf)) {
+                flush = 1;
+                break;
+            }
+
             size = in->buf->last - in->buf->pos;
 
-            if (size > buf->end - buf->last) {
-                size = buf->end - buf->last;
+            if (size > end - buf->last) {
+                size = end - buf->last;
             }
 
             if (send + size > limit) {
@@ -1605,13 +1845,45 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
             }
         }
 
-        if (!flush && send < limit && buf->last < buf->end) {
+        if (!flush && send < limit && buf->last < end) {
             break;
         }
 
         size = buf->last - buf->pos;
 
         if (size == 0) {
+
+            /* the kernel encrypts file data, so it is sent with sendfile() */
+
+            if (in && ngx_ssl_sendfile_buf(c, in->buf)) {
+
+                size = (ssize_t) ngx_min(in->buf->file_last - in->buf->file_pos,
+                                         limit - send);
+
+                n = ngx_ssl_sendfile(c, in->buf, size);
+
+                if (n == NGX_ERROR) {
+                    return NGX_CHAIN_ERROR;
+                }
+
+                if (n == NGX_AGAIN) {
+                    break;
+                }
+
+                in->buf->file_pos += n;
+                send += n;
+
+                if (in->buf->file_pos == in->buf->file_last) {
+                    in = in->next;
+                }
+
+                if (n < size || send == limit) {
+                    break;
+                }
+
+                continue;
+            }
+
             buf->flush = 0;
             c->buffered &= ~NGX_SSL_BUFFERED;
             return in;
@@ -1629,6 +1901,9 @@ ngx_ssl_send_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 
         buf->pos += n;
 
+        c->ssl->dyn_rec_records++;
+        c->ssl->dyn_rec_last_write = ngx_current_msec;
+
         if (n < size) {
             break;
         }
@@ -1672,6 +1947,10 @@ ngx_ssl_write(ngx_connection_t *c, u_char *data, size_t size)
 
     if (n > 0) {
 
+#ifdef SSL_MODE_ASYNC
+        ngx_ssl_async_clear(c);
+#endif
+
         if (c->ssl->saved_read_handler) {
 
             c->read->handler = c->ssl->saved_read_handler;
@@ -1701,6 +1980,20 @@ ngx_ssl_write(ngx_connection_t *c, u_char *data, size_t size)
         return NGX_AGAIN;
     }
 
+#ifdef SSL_MODE_ASYNC
+
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        c->write->ready = 0;
+
+        if (ngx_ssl_async_wait(c, 1) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     if (sslerr == SSL_ERROR_WANT_READ) {
 
         ngx_log_error(NGX_LOG_INFO, c->log, 0,
@@ -1735,6 +2028,108 @@ ngx_ssl_write(ngx_connection_t *c, u_char *data, size_t size)
 }
 
 
+static ssize_t
+ngx_ssl_sendfile(ngx_connection_t *c, ngx_buf_t *file, size_t size)
+{
+#ifdef BIO_get_ktls_send
+
+    int        sslerr;
+    ssize_t    n;
+    ngx_err_t  err;
+
+    ngx_ssl_clear_error(c->log);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "SSL sendfile: @%O %uz", file->file_pos, size);
+
+    n = SSL_sendfile(c->ssl->connection, file->file->fd, file->file_pos,
+                     size, 0);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL_sendfile: %z", n);
+
+    if (n > 0) {
+
+#ifdef SSL_MODE_ASYNC
+        ngx_ssl_async_clear(c);
+#endif
+
+        if (c->ssl->saved_read_handler) {
+
+            c->read->handler = c->ssl->saved_read_handler;
+            c->ssl->saved_read_handler = NULL;
+            c->read->ready = 1;
+
+            if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            ngx_post_event(c->read, &ngx_posted_events);
+        }
+
+        c->sent += n;
+
+        return n;
+    }
+
+    if (n == 0) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                      "SSL_sendfile() reported that \"%s\" was truncated",
+                      file->file->name.data);
+        return NGX_ERROR;
+    }
+
+    sslerr = SSL_get_error(c->ssl->connection, n);
+
+    if (sslerr == SSL_ERROR_ZERO_RETURN) {
+
+        /* OpenSSL fails to return SSL_ERROR_SYSCALL if an error happens */
+
+        sslerr = SSL_ERROR_SYSCALL;
+        ngx_set_errno(NGX_EPIPE);
+    }
+
+    err = (sslerr == SSL_ERROR_SYSCALL) ? ngx_errno : 0;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL_get_error: %d", sslerr);
+
+    if (sslerr == SSL_ERROR_WANT_WRITE
+        || (sslerr == SSL_ERROR_SYSCALL && err == NGX_EAGAIN))
+    {
+        c->write->ready = 0;
+        return NGX_AGAIN;
+    }
+
+#ifdef SSL_MODE_ASYNC
+
+    if (sslerr == SSL_ERROR_WANT_ASYNC) {
+        c->write->ready = 0;
+
+        if (ngx_ssl_async_wait(c, 1) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
+    c->ssl->no_wait_shutdown = 1;
+    c->ssl->no_send_shutdown = 1;
+    c->write->error = 1;
+
+    ngx_ssl_connection_error(c, sslerr, err, "SSL_sendfile() failed");
+
+#else
+
+    ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                  "SSL_sendfile() not available");
+
+#endif
+
+    return NGX_ERROR;
+}
+
+
 static void
 ngx_ssl_read_handler(ngx_event_t *rev)
 {
@@ -1763,6 +2158,10 @@ ngx_ssl_shutdown(ngx_connection_t *c)
     int        n, sslerr, mode;
     ngx_err_t  err;
 
+#ifdef SSL_MODE_ASYNC
+    ngx_ssl_async_clear(c);
+#endif
+
     if (c->timedout) {
         mode = SSL_RECEIVED_SHUTDOWN|SSL_SENT_SHUTDOWN;
         SSL_set_quiet_shutdown(c->ssl->connection, 1);
@@ -1791,6 +2190,23 @@ ngx_ssl_shutdown(ngx_connection_t *c)
 
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0, "SSL_shutdown: %d", n);
 
+#ifdef SSL_MODE_ASYNC
+
+    /* a paused job does not leave an error in the queue */
+
+    if (n < 0 && SSL_waiting_for_async(c->ssl->connection)) {
+        c->read->handler = ngx_ssl_shutdown_handler;
+        c->write->handler = ngx_ssl_shutdown_handler;
+
+        if (ngx_ssl_async_wait(c, 0) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_AGAIN;
+    }
+
+#endif
+
     sslerr = 0;
 
     /* SSL_shutdown() never returns -1, on error it returns 0 */
@@ -2047,6 +2463,64 @@ ngx_ssl_error(ngx_uint_t level, ngx_log_t *log, ngx_err_t err, char *fmt, ...)
 }
 
 
+/*
+ * stock OpenSSL never pauses a job, so the mode is only useful with an
+ * async-capable engine, which has to be loaded with "ssl_engine" before
+ * the "http" block is parsed
+ */
+
+ngx_int_t
+ngx_ssl_async(ngx_conf_t *cf, ngx_ssl_t *ssl)
+{
+#ifdef SSL_MODE_ASYNC
+
+    ngx_openssl_conf_t  *oscf;
+
+    oscf = (ngx_openssl_conf_t *) ngx_get_conf(cf->cycle->conf_ctx,
+                                               ngx_openssl_module);
+
+    if (!oscf->engine) {
+        ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                      "\"ssl_async\" requires an async-capable engine "
+                      "loaded with \"ssl_engine\"");
+        return NGX_ERROR;
+    }
+
+    SSL_CTX_set_mode(ssl->ctx, SSL_MODE_ASYNC);
+
+    return NGX_OK;
+
+#else
+
+    ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                  "\"ssl_async\" is not supported by this OpenSSL version");
+
+    return NGX_ERROR;
+
+#endif
+}
+
+
+ngx_int_t
+ngx_ssl_ktls(ngx_conf_t *cf, ngx_ssl_t *ssl)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+
+    SSL_CTX_set_options(ssl->ctx, SSL_OP_ENABLE_KTLS);
+
+    return NGX_OK;
+
+#else
+
+    ngx_log_error(NGX_LOG_EMERG, ssl->log, 0,
+                  "\"ssl_ktls\" is not supported by this OpenSSL version");
+
+    return NGX_ERROR;
+
+#endif
+}
+
+
 ngx_int_t
 ngx_ssl_session_cache(ngx_ssl_t *ssl, ngx_str_t *sess_ctx,
     ssize_t builtin_session_cache, ngx_shm_zone_t *shm_zone, time_t timeout)
@@ -2210,22 +2684,85 @@ failed:
 }
 
 
+/*
+ * every declaration of a shared session cache sets the number of shards
+ * of its zone, so declarations which differ are rejected regardless of
+ * their order
+ */
+
+char *
+ngx_ssl_session_cache_shards(ngx_conf_t *cf, ngx_shm_zone_t *shm_zone,
+    ngx_uint_t shards)
+{
+    ngx_ssl_session_cache_conf_t  *sccf;
+
+    sccf = shm_zone->data;
+
+    if (sccf) {
+        if (sccf->nshards != shards) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "session cache \"%V\" is already declared "
+                               "with %ui shards", &shm_zone->shm.name,
+                               sccf->nshards);
+            return NGX_CONF_ERROR;
+        }
+
+        return NGX_CONF_OK;
+    }
+
+#if !(NGX_HAVE_ATOMIC_OPS)
+
+    if (shards) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "session cache shards require atomic operations");
+        return NGX_CONF_ERROR;
+    }
+
+#endif
+
+    sccf = ngx_pcalloc(cf->pool, sizeof(ngx_ssl_session_cache_conf_t));
+    if (sccf == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    sccf->nshards = shards;
+
+    shm_zone->data = sccf;
+
+    return NGX_CONF_OK;
+}
+
+
 ngx_int_t
 ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
-    size_t                    len;
-    ngx_slab_pool_t          *shpool;
-    ngx_ssl_session_cache_t  *cache;
+    ngx_ssl_session_cache_conf_t  *osccf = data;
+
+    size_t                         len;
+    ngx_slab_pool_t               *shpool;
+    ngx_ssl_session_cache_t       *cache;
+    ngx_ssl_session_cache_conf_t  *sccf;
+
+    sccf = shm_zone->data;
+
+    if (osccf) {
+        if (osccf->nshards != sccf->nshards) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "session cache \"%V\" uses %ui shards "
+                          "while previously it used %ui",
+                          &shm_zone->shm.name, sccf->nshards,
+                          osccf->nshards);
+            return NGX_ERROR;
+        }
 
-    if (data) {
-        shm_zone->data = data;
+        sccf->cache = osccf->cache;
         return NGX_OK;
     }
 
     shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
 
     if (shm_zone->shm.exists) {
-        shm_zone->data = shpool->data;
+        sccf->cache = shpool->data;
         return NGX_OK;
     }
 
@@ -2235,13 +2772,23 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
     }
 
     shpool->data = cache;
-    shm_zone->data = cache;
+    sccf->cache = cache;
 
     ngx_rbtree_init(&cache->session_rbtree, &cache->sentinel,
                     ngx_ssl_session_rbtree_insert_value);
 
     ngx_queue_init(&cache->expire_queue);
 
+    cache->nshards = 0;
+    cache->shards = NULL;
+
+    if (sccf->nshards
+        && ngx_ssl_session_cache_init_shards(shm_zone, cache, sccf->nshards)
+           != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
     len = sizeof(" in SSL session shared cache \"\"") + shm_zone->shm.name.len;
 
     shpool->log_ctx = ngx_slab_alloc(shpool, len);
@@ -2258,6 +2805,185 @@ ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 }
 
 
+/*
+ * A sharded cache keeps sessions in fixed-size slots instead of the rbtree:
+ * a session id hash selects a shard, which has its own lock, and a bucket
+ * of NGX_SSL_SESSION_SLOT_WAYS slots in it; a new session replaces an empty
+ * or expired slot, or the slot which expires first.  Sessions which do not
+ * fit into a slot are not cached.
+ */
+
+static ngx_int_t
+ngx_ssl_session_cache_init_shards(ngx_shm_zone_t *shm_zone,
+    ngx_ssl_session_cache_t *cache, ngx_uint_t nshards)
+{
+#if (NGX_HAVE_ATOMIC_OPS)
+
+    size_t                    size;
+    ngx_uint_t                i, nbuckets;
+    ngx_slab_pool_t          *shpool;
+    ngx_ssl_session_shard_t  *shard;
+
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    shard = ngx_slab_alloc(shpool, nshards * sizeof(ngx_ssl_session_shard_t));
+    if (shard == NULL) {
+        return NGX_ERROR;
+    }
+
+    /* leave an eighth of the zone for the slab pages and the metadata */
+
+    size = shm_zone->shm.size / 8 * 7 / nshards;
+
+    nbuckets = size / (NGX_SSL_SESSION_SLOT_WAYS * NGX_SSL_SESSION_SLOT_SIZE);
+
+    if (nbuckets == 0) {
+        ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                      "session cache \"%V\" is too small for %ui shards",
+                      &shm_zone->shm.name, nshards);
+        return NGX_ERROR;
+    }
+
+    size = nbuckets * NGX_SSL_SESSION_SLOT_WAYS * NGX_SSL_SESSION_SLOT_SIZE;
+
+    for (i = 0; i < nshards; i++) {
+
+        shard[i].slots = ngx_slab_alloc(shpool, size);
+        if (shard[i].slots == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memzero(shard[i].slots, size);
+
+        shard[i].nbuckets = nbuckets;
+
+        ngx_memzero(&shard[i].lock, sizeof(ngx_shmtx_sh_t));
+
+        if (ngx_shmtx_create(&shard[i].mutex, &shard[i].lock, NULL)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    cache->shards = shard;
+    cache->nshards = nshards;
+
+    return NGX_OK;
+
+#else
+
+    return NGX_ERROR;
+
+#endif
+}
+
+
+static ngx_ssl_sess_slot_t *
+ngx_ssl_session_bucket(ngx_ssl_session_cache_t *cache, uint32_t hash,
+    ngx_ssl_session_shard_t **shard)
+{
+    ngx_ssl_session_shard_t  *sh;
+
+    sh = &cache->shards[hash % cache->nshards];
+    *shard = sh;
+
+    return (ngx_ssl_sess_slot_t *)
+               (sh->slots + (hash / cache->nshards) % sh->nbuckets
+                            * NGX_SSL_SESSION_SLOT_WAYS
+                            * NGX_SSL_SESSION_SLOT_SIZE);
+}
+
+
+#define ngx_ssl_session_slot(bucket, n)                                       \
+    ((ngx_ssl_sess_slot_t *) ((u_char *) (bucket)                             \
+                              + (n) * NGX_SSL_SESSION_SLOT_SIZE))
+
+
+static ngx_ssl_sess_slot_t *
+ngx_ssl_session_slot_find(ngx_ssl_sess_slot_t *bucket, uint32_t hash,
+    const u_char *id, size_t len)
+{
+    ngx_uint_t            i;
+    ngx_ssl_sess_slot_t  *slot;
+
+    for (i = 0; i < NGX_SSL_SESSION_SLOT_WAYS; i++) {
+        slot = ngx_ssl_session_slot(bucket, i);
+
+        if (slot->expire
+            && slot->hash == hash
+            && slot->id_len == len
+            && ngx_memcmp(slot->id, id, len) == 0)
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_ssl_session_slot_store(ngx_ssl_session_cache_t *cache, u_char *id,
+    size_t id_len, u_char *buf, size_t len, time_t expire, ngx_log_t *log)
+{
+    time_t                    now;
+    uint32_t                  hash;
+    ngx_uint_t                i;
+    ngx_ssl_sess_slot_t      *bucket, *slot, *victim;
+    ngx_ssl_session_shard_t  *shard;
+
+    if (id_len > sizeof(slot->id)
+        || len > NGX_SSL_SESSION_SLOT_SIZE
+                 - offsetof(ngx_ssl_sess_slot_t, session))
+    {
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, log, 0,
+                       "ssl session does not fit into a slot: %uz:%uz",
+                       id_len, len);
+        return;
+    }
+
+    hash = ngx_crc32_short(id, id_len);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "ssl new session: %08XD:%uz:%uz", hash, id_len, len);
+
+    bucket = ngx_ssl_session_bucket(cache, hash, &shard);
+
+    now = ngx_time();
+
+    ngx_shmtx_lock(&shard->mutex);
+
+    victim = ngx_ssl_session_slot_find(bucket, hash, id, id_len);
+
+    if (victim == NULL) {
+
+        for (i = 0; i < NGX_SSL_SESSION_SLOT_WAYS; i++) {
+            slot = ngx_ssl_session_slot(bucket, i);
+
+            if (slot->expire <= now) {
+                victim = slot;
+                break;
+            }
+
+            if (victim == NULL || slot->expire < victim->expire) {
+                victim = slot;
+            }
+        }
+    }
+
+    victim->expire = expire;
+    victim->hash = hash;
+    victim->len = (uint16_t) len;
+    victim->id_len = (u_char) id_len;
+
+    ngx_memcpy(victim->id, id, id_len);
+    ngx_memcpy(victim->session, buf, len);
+
+    ngx_shmtx_unlock(&shard->mutex);
+}
+
+
 /*
  * The length of the session id is 16 bytes for SSLv2 sessions and
  * between 1 and 32 bytes for SSLv3/TLSv1, typically 32 bytes.
@@ -2306,7 +3032,28 @@ ngx_ssl_new_session(ngx_ssl_conn_t *ssl_conn, ngx_ssl_session_t *sess)
     ssl_ctx = SSL_get_SSL_CTX(ssl_conn);
     shm_zone = SSL_CTX_get_ex_data(ssl_ctx, ngx_ssl_session_cache_index);
 
-    cache = shm_zone->data;
+    cache = ((ngx_ssl_session_cache_conf_t *) shm_zone->data)->cache;
+
+    if (cache->nshards) {
+
+#if OPENSSL_VERSION_NUMBER >= 0x0090800fL
+
+        session_id = (u_char *) SSL_SESSION_get_id(sess, &session_id_length);
+
+#else
+
+        session_id = sess->session_id;
+        session_id_length = sess->session_id_length;
+
+#endif
+
+        ngx_ssl_session_slot_store(cache, session_id, session_id_length,
+                                   buf, len,
+                                   ngx_time() + SSL_CTX_get_timeout(ssl_ctx),
+                                   c->log);
+        return 0;
+    }
+
     shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
 
     ngx_shmtx_lock(&shpool->mutex);
@@ -2439,7 +3186,9 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn, u_char *id, int len,
     ngx_rbtree_node_t        *node, *sentinel;
     ngx_ssl_session_t        *sess;
     ngx_ssl_sess_id_t        *sess_id;
+    ngx_ssl_sess_slot_t      *slot;
     ngx_ssl_session_cache_t  *cache;
+    ngx_ssl_session_shard_t  *shard;
     u_char                    buf[NGX_SSL_MAX_SESSION_SIZE];
 #if (NGX_DEBUG)
     ngx_connection_t         *c;
@@ -2458,10 +3207,37 @@ ngx_ssl_get_cached_session(ngx_ssl_conn_t *ssl_conn, u_char *id, int len,
     shm_zone = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl_conn),
                                    ngx_ssl_session_cache_index);
 
-    cache = shm_zone->data;
+    cache = ((ngx_ssl_session_cache_conf_t *) shm_zone->data)->cache;
 
     sess = NULL;
 
+    if (cache->nshards) {
+        slot = ngx_ssl_session_bucket(cache, hash, &shard);
+
+        ngx_shmtx_lock(&shard->mutex);
+
+        slot = ngx_ssl_session_slot_find(slot, hash, id, (size_t) len);
+
+        if (slot == NULL) {
+            ngx_shmtx_unlock(&shard->mutex);
+            return NULL;
+        }
+
+        if (slot->expire <= ngx_time()) {
+            slot->expire = 0;
+            ngx_shmtx_unlock(&shard->mutex);
+            return NULL;
+        }
+
+        ngx_memcpy(buf, slot->session, slot->len);
+        len = slot->len;
+
+        ngx_shmtx_unlock(&shard->mutex);
+
+        p = buf;
+        return d2i_SSL_SESSION(NULL, &p, len);
+    }
+
     shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
 
     ngx_shmtx_lock(&shpool->mutex);
@@ -2546,7 +3322,9 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
     ngx_slab_pool_t          *shpool;
     ngx_rbtree_node_t        *node, *sentinel;
     ngx_ssl_sess_id_t        *sess_id;
+    ngx_ssl_sess_slot_t      *slot;
     ngx_ssl_session_cache_t  *cache;
+    ngx_ssl_session_shard_t  *shard;
 
     shm_zone = SSL_CTX_get_ex_data(ssl, ngx_ssl_session_cache_index);
 
@@ -2554,7 +3332,7 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
         return;
     }
 
-    cache = shm_zone->data;
+    cache = ((ngx_ssl_session_cache_conf_t *) shm_zone->data)->cache;
 
 #if OPENSSL_VERSION_NUMBER >= 0x0090800fL
 
@@ -2572,6 +3350,22 @@ ngx_ssl_remove_session(SSL_CTX *ssl, ngx_ssl_session_t *sess)
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ngx_cycle->log, 0,
                    "ssl remove session: %08XD:%ud", hash, len);
 
+    if (cache->nshards) {
+        slot = ngx_ssl_session_bucket(cache, hash, &shard);
+
+        ngx_shmtx_lock(&shard->mutex);
+
+        slot = ngx_ssl_session_slot_find(slot, hash, id, len);
+
+        if (slot) {
+            slot->expire = 0;
+        }
+
+        ngx_shmtx_unlock(&shard->mutex);
+
+        return;
+    }
+
     shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
 
     ngx_shmtx_lock(&shpool->mutex);
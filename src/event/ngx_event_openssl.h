@@ -37,10 +37,18 @@
 #define ngx_ssl_conn_t          SSL
 
 
+typedef struct {
+    ngx_msec_t                  timeout;
+    ngx_uint_t                  threshold;
+    size_t                      size_lo;
+} ngx_ssl_dyn_rec_t;
+
+
 typedef struct {
     SSL_CTX                    *ctx;
     ngx_log_t                  *log;
     size_t                      buffer_size;
+    ngx_ssl_dyn_rec_t           dyn_rec;
 } ngx_ssl_t;
 
 
@@ -51,17 +59,28 @@ typedef struct {
     ngx_buf_t                  *buf;
     size_t                      buffer_size;
 
+    ngx_ssl_dyn_rec_t           dyn_rec;
+    ngx_msec_t                  dyn_rec_last_write;
+    ngx_uint_t                  dyn_rec_records;
+
     ngx_connection_handler_pt   handler;
 
     ngx_event_handler_pt        saved_read_handler;
     ngx_event_handler_pt        saved_write_handler;
 
+#ifdef SSL_MODE_ASYNC
+    /* a connection for the async job wait fd of an engine */
+    ngx_connection_t           *async;
+#endif
+
     unsigned                    handshaked:1;
     unsigned                    renegotiation:1;
     unsigned                    buffer:1;
     unsigned                    no_wait_shutdown:1;
     unsigned                    no_send_shutdown:1;
     unsigned                    handshake_buffer_set:1;
+    unsigned                    sendfile:1;
+    unsigned                    async_write:1;
 } ngx_ssl_connection_t;
 
 
@@ -89,13 +108,46 @@ struct ngx_ssl_sess_id_s {
 };
 
 
+#define NGX_SSL_MAX_SESSION_SHARDS  64
+#define NGX_SSL_SESSION_SLOT_SIZE   512
+#define NGX_SSL_SESSION_SLOT_WAYS   4
+
+
+typedef struct {
+    time_t                      expire;
+    uint32_t                    hash;
+    uint16_t                    len;
+    u_char                      id_len;
+    u_char                      id[32];
+    u_char                      session[1];
+} ngx_ssl_sess_slot_t;
+
+
+typedef struct {
+    ngx_shmtx_sh_t              lock;
+    ngx_shmtx_t                 mutex;
+    ngx_uint_t                  nbuckets;
+    u_char                     *slots;
+} ngx_ssl_session_shard_t;
+
+
 typedef struct {
     ngx_rbtree_t                session_rbtree;
     ngx_rbtree_node_t           sentinel;
     ngx_queue_t                 expire_queue;
+    ngx_uint_t                  nshards;
+    ngx_ssl_session_shard_t    *shards;
 } ngx_ssl_session_cache_t;
 
 
+/* the data of a session cache zone, the number of shards is 0 if unsharded */
+
+typedef struct {
+    ngx_uint_t                  nshards;
+    ngx_ssl_session_cache_t    *cache;
+} ngx_ssl_session_cache_conf_t;
+
+
 #ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
 
 typedef struct {
@@ -142,7 +194,11 @@ ngx_int_t ngx_ssl_session_cache(ngx_ssl_t *ssl, ngx_str_t *sess_ctx,
     ssize_t builtin_session_cache, ngx_shm_zone_t *shm_zone, time_t timeout);
 ngx_int_t ngx_ssl_session_ticket_keys(ngx_conf_t *cf, ngx_ssl_t *ssl,
     ngx_array_t *paths);
+ngx_int_t ngx_ssl_async(ngx_conf_t *cf, ngx_ssl_t *ssl);
+ngx_int_t ngx_ssl_ktls(ngx_conf_t *cf, ngx_ssl_t *ssl);
 ngx_int_t ngx_ssl_session_cache_init(ngx_shm_zone_t *shm_zone, void *data);
+char *ngx_ssl_session_cache_shards(ngx_conf_t *cf, ngx_shm_zone_t *shm_zone,
+    ngx_uint_t shards);
 ngx_int_t ngx_ssl_create_connection(ngx_ssl_t *ssl, ngx_connection_t *c,
     ngx_uint_t flags);
 
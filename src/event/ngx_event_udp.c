@@ -0,0 +1,662 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+#if !(NGX_WIN32)
+
+static void ngx_event_udp_datagram(ngx_event_t *ev, struct sockaddr *sa,
+    socklen_t socklen, u_char *data, size_t size);
+static uint32_t ngx_udp_session_hash(struct sockaddr *sa);
+static ngx_int_t ngx_udp_session_cmp(struct sockaddr *sa1,
+    struct sockaddr *sa2);
+static ngx_connection_t *ngx_udp_session_lookup(ngx_listening_t *ls,
+    struct sockaddr *sa, uint32_t hash);
+static void ngx_udp_session_cleanup(void *data);
+static void ngx_close_udp_session(ngx_connection_t *c);
+static ssize_t ngx_udp_shared_recv(ngx_connection_t *c, u_char *buf,
+    size_t size);
+static ssize_t ngx_udp_shared_send(ngx_connection_t *c, u_char *buf,
+    size_t size);
+
+
+static u_char  ngx_udp_buffers[NGX_UDP_BATCH][NGX_UDP_MAX_DATAGRAM];
+static u_char  ngx_udp_sockaddrs[NGX_UDP_BATCH][NGX_SOCKADDRLEN];
+
+
+void
+ngx_event_recvmsg(ngx_event_t *ev)
+{
+    ssize_t            n;
+    ngx_int_t          i;
+    ngx_err_t          err;
+    ngx_listening_t   *ls;
+    ngx_connection_t  *lc;
+    ngx_event_conf_t  *ecf;
+    struct iovec       iov[NGX_UDP_BATCH];
+#if (NGX_HAVE_RECVMMSG)
+    struct mmsghdr     msgs[NGX_UDP_BATCH];
+#else
+    struct msghdr      msg;
+#endif
+    struct msghdr     *mh;
+
+    if (ev->timedout) {
+        ev->timedout = 0;
+    }
+
+    ecf = ngx_event_get_conf(ngx_cycle->conf_ctx, ngx_event_core_module);
+
+    if (!(ngx_event_flags & NGX_USE_KQUEUE_EVENT)) {
+        ev->available = ecf->multi_accept;
+    }
+
+    lc = ev->data;
+    ls = lc->listening;
+
+    ev->ready = 0;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "recvmsg on %V, ready: %d", &ls->addr_text, ev->available);
+
+    do {
+
+        for (i = 0; i < NGX_UDP_BATCH; i++) {
+            iov[i].iov_base = (void *) ngx_udp_buffers[i];
+            iov[i].iov_len = NGX_UDP_MAX_DATAGRAM;
+
+#if (NGX_HAVE_RECVMMSG)
+            mh = &msgs[i].msg_hdr;
+#else
+            mh = &msg;
+#endif
+
+            ngx_memzero(mh, sizeof(struct msghdr));
+
+            mh->msg_name = ngx_udp_sockaddrs[i];
+            mh->msg_namelen = NGX_SOCKADDRLEN;
+            mh->msg_iov = &iov[i];
+            mh->msg_iovlen = 1;
+        }
+
+#if (NGX_HAVE_RECVMMSG)
+        n = recvmmsg(lc->fd, msgs, NGX_UDP_BATCH, 0, NULL);
+#else
+        n = recvmsg(lc->fd, &msg, 0);
+#endif
+
+        if (n == -1) {
+            err = ngx_socket_errno;
+
+            if (err == NGX_EAGAIN || err == NGX_EINTR) {
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
+                               "recvmsg() not ready");
+                return;
+            }
+
+            ngx_log_error(NGX_LOG_ALERT, ev->log, err, "recvmsg() failed");
+
+            return;
+        }
+
+#if !(NGX_HAVE_RECVMMSG)
+        iov[0].iov_len = n;
+        n = 1;
+#endif
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "recvmsg: %z datagrams", n);
+
+        for (i = 0; i < n; i++) {
+
+#if (NGX_HAVE_RECVMMSG)
+            mh = &msgs[i].msg_hdr;
+            iov[i].iov_len = msgs[i].msg_len;
+#else
+            mh = &msg;
+#endif
+
+            if (mh->msg_flags & MSG_TRUNC) {
+                ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
+                              "recvmsg() truncated data");
+                continue;
+            }
+
+            if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+                ev->available -= iov[i].iov_len;
+            }
+
+            ngx_event_udp_datagram(ev, mh->msg_name, mh->msg_namelen,
+                                   iov[i].iov_base, iov[i].iov_len);
+        }
+
+        if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+            continue;
+        }
+
+        /*
+         * the listening socket is level-triggered, so a short batch
+         * means that the queue is drained and another call is not needed
+         */
+
+        if (n < NGX_UDP_BATCH) {
+            return;
+        }
+
+        if (ev->available > 0) {
+            ev->available = (ev->available > n) ? ev->available - n : 0;
+        }
+
+    } while (ev->available);
+}
+
+
+static void
+ngx_event_udp_datagram(ngx_event_t *ev, struct sockaddr *sa,
+    socklen_t socklen, u_char *data, size_t size)
+{
+    uint32_t             hash;
+    ngx_buf_t            buf;
+    ngx_log_t           *log;
+    ngx_event_t         *rev, *wev;
+    ngx_listening_t     *ls;
+    ngx_connection_t    *c, *lc;
+    ngx_udp_session_t   *udp;
+    ngx_pool_cleanup_t  *cln;
+
+    lc = ev->data;
+    ls = lc->listening;
+
+    ngx_memzero(&buf, sizeof(ngx_buf_t));
+
+    buf.start = data;
+    buf.pos = data;
+    buf.last = data + size;
+    buf.end = buf.last;
+    buf.memory = 1;
+
+    hash = ngx_udp_session_hash(sa);
+
+    c = ngx_udp_session_lookup(ls, sa, hash);
+
+    if (c) {
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "*%uA udp datagram: %uz", c->number, size);
+
+        if (c->read->handler == NULL) {
+            return;
+        }
+
+        c->udp->buffer = &buf;
+
+        c->read->handler(c->read);
+
+        if (c->udp) {
+            c->udp->buffer = NULL;
+        }
+
+        return;
+    }
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
+#endif
+
+    ngx_accept_disabled = ngx_cycle->connection_n / 8
+                          - ngx_cycle->free_connection_n;
+
+    c = ngx_get_connection(lc->fd, ev->log);
+
+    if (c == NULL) {
+        ls->dropped++;
+        return;
+    }
+
+    c->shared = 1;
+    c->type = SOCK_DGRAM;
+    c->socklen = socklen;
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_active, 1);
+#endif
+
+    c->pool = ngx_create_pool(ls->pool_size, ev->log);
+    if (c->pool == NULL) {
+        ngx_close_udp_session(c);
+        return;
+    }
+
+    c->sockaddr = ngx_palloc(c->pool, socklen);
+    if (c->sockaddr == NULL) {
+        ngx_close_udp_session(c);
+        return;
+    }
+
+    ngx_memcpy(c->sockaddr, sa, socklen);
+
+    log = ngx_palloc(c->pool, sizeof(ngx_log_t));
+    if (log == NULL) {
+        ngx_close_udp_session(c);
+        return;
+    }
+
+    *log = ls->log;
+
+    c->recv = ngx_udp_shared_recv;
+    c->send = ngx_udp_shared_send;
+
+    c->log = log;
+    c->pool->log = log;
+
+    c->listening = ls;
+    c->local_sockaddr = ls->sockaddr;
+    c->local_socklen = ls->socklen;
+
+    rev = c->read;
+    wev = c->write;
+
+    /*
+     * the events of a session are never added to the event module,
+     * datagrams are passed to the read handler and sending never blocks
+     */
+
+    rev->ready = 1;
+    wev->ready = 1;
+
+    rev->log = log;
+    wev->log = log;
+
+    c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+
+    ls->accepted++;
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
+#endif
+
+    if (ls->addr_ntop) {
+        c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
+        if (c->addr_text.data == NULL) {
+            ngx_close_udp_session(c);
+            return;
+        }
+
+        c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
+                                         c->addr_text.data,
+                                         ls->addr_text_max_len, 0);
+        if (c->addr_text.len == 0) {
+            ngx_close_udp_session(c);
+            return;
+        }
+    }
+
+    udp = ngx_palloc(c->pool, sizeof(ngx_udp_session_t));
+    if (udp == NULL) {
+        ngx_close_udp_session(c);
+        return;
+    }
+
+    cln = ngx_pool_cleanup_add(c->pool, 0);
+    if (cln == NULL) {
+        ngx_close_udp_session(c);
+        return;
+    }
+
+    udp->node.key = hash;
+    udp->connection = c;
+    udp->buffer = &buf;
+    udp->closed = 0;
+
+    ngx_rbtree_insert(&ls->rbtree, &udp->node);
+
+    cln->handler = ngx_udp_session_cleanup;
+    cln->data = udp;
+
+    c->udp = udp;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "*%uA udp session: %V fd:%d", c->number, &c->addr_text,
+                   c->fd);
+
+    log->data = NULL;
+    log->handler = NULL;
+
+    ls->handler(c);
+
+    if (c->udp) {
+        c->udp->buffer = NULL;
+    }
+}
+
+
+static uint32_t
+ngx_udp_session_hash(struct sockaddr *sa)
+{
+    uint32_t              hash;
+    struct sockaddr_in   *sin;
+#if (NGX_HAVE_INET6)
+    struct sockaddr_in6  *sin6;
+#endif
+
+    ngx_crc32_init(hash);
+
+    switch (sa->sa_family) {
+
+#if (NGX_HAVE_INET6)
+    case AF_INET6:
+        sin6 = (struct sockaddr_in6 *) sa;
+        ngx_crc32_update(&hash, (u_char *) &sin6->sin6_addr, 16);
+        ngx_crc32_update(&hash, (u_char *) &sin6->sin6_port,
+                         sizeof(in_port_t));
+        break;
+#endif
+
+    default: /* AF_INET */
+        sin = (struct sockaddr_in *) sa;
+        ngx_crc32_update(&hash, (u_char *) &sin->sin_addr, 4);
+        ngx_crc32_update(&hash, (u_char *) &sin->sin_port,
+                         sizeof(in_port_t));
+        break;
+    }
+
+    ngx_crc32_final(hash);
+
+    return hash;
+}
+
+
+static ngx_int_t
+ngx_udp_session_cmp(struct sockaddr *sa1, struct sockaddr *sa2)
+{
+    ngx_int_t             rc;
+    struct sockaddr_in   *sin1, *sin2;
+#if (NGX_HAVE_INET6)
+    struct sockaddr_in6  *sin61, *sin62;
+#endif
+
+    if (sa1->sa_family != sa2->sa_family) {
+        return sa1->sa_family - sa2->sa_family;
+    }
+
+    switch (sa1->sa_family) {
+
+#if (NGX_HAVE_INET6)
+    case AF_INET6:
+        sin61 = (struct sockaddr_in6 *) sa1;
+        sin62 = (struct sockaddr_in6 *) sa2;
+
+        rc = ngx_memcmp(&sin61->sin6_addr, &sin62->sin6_addr, 16);
+        if (rc != 0) {
+            return rc;
+        }
+
+        return (ngx_int_t) sin61->sin6_port - (ngx_int_t) sin62->sin6_port;
+#endif
+
+    default: /* AF_INET */
+        sin1 = (struct sockaddr_in *) sa1;
+        sin2 = (struct sockaddr_in *) sa2;
+
+        rc = ngx_memcmp(&sin1->sin_addr, &sin2->sin_addr, 4);
+        if (rc != 0) {
+            return rc;
+        }
+
+        return (ngx_int_t) sin1->sin_port - (ngx_int_t) sin2->sin_port;
+    }
+}
+
+
+void
+ngx_udp_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t  **p;
+    ngx_udp_session_t   *udp, *udpt;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            udp = (ngx_udp_session_t *) node;
+            udpt = (ngx_udp_session_t *) temp;
+
+            p = (ngx_udp_session_cmp(udp->connection->sockaddr,
+                                     udpt->connection->sockaddr)
+                 < 0)
+                ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static ngx_connection_t *
+ngx_udp_session_lookup(ngx_listening_t *ls, struct sockaddr *sa,
+    uint32_t hash)
+{
+    ngx_int_t           rc;
+    ngx_rbtree_node_t  *node, *sentinel;
+    ngx_udp_session_t  *udp;
+
+    node = ls->rbtree.root;
+    sentinel = ls->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (hash < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (hash > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* hash == node->key */
+
+        udp = (ngx_udp_session_t *) node;
+
+        rc = ngx_udp_session_cmp(sa, udp->connection->sockaddr);
+
+        if (rc == 0) {
+            return udp->connection;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_udp_session_cleanup(void *data)
+{
+    ngx_udp_session_t  *udp = data;
+
+    if (!udp->closed) {
+        ngx_rbtree_delete(&udp->connection->listening->rbtree, &udp->node);
+    }
+
+    udp->connection->udp = NULL;
+}
+
+
+void
+ngx_close_udp_sessions(ngx_listening_t *ls)
+{
+    ngx_connection_t   *c;
+    ngx_rbtree_node_t  *node, *sentinel;
+    ngx_udp_session_t  *udp;
+
+    /*
+     * the sessions send their replies through the listening socket,
+     * so they are finalized before the socket is closed: the read handler
+     * is called with eof set, and recv() and send() fail from now on
+     */
+
+    sentinel = ls->rbtree.sentinel;
+
+    while (ls->rbtree.root != sentinel) {
+        node = ngx_rbtree_min(ls->rbtree.root, sentinel);
+
+        ngx_rbtree_delete(&ls->rbtree, node);
+
+        udp = (ngx_udp_session_t *) node;
+        udp->closed = 1;
+        udp->buffer = NULL;
+
+        c = udp->connection;
+
+        ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "*%uA close udp session", c->number);
+
+        c->read->ready = 1;
+        c->read->delayed = 0;
+        c->read->eof = 1;
+
+        if (c->read->handler) {
+            c->read->handler(c->read);
+        }
+    }
+}
+
+
+static void
+ngx_close_udp_session(ngx_connection_t *c)
+{
+    ngx_free_connection(c);
+
+    c->fd = (ngx_socket_t) -1;
+
+    if (c->pool) {
+        ngx_destroy_pool(c->pool);
+    }
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_active, -1);
+#endif
+}
+
+
+static ssize_t
+ngx_udp_shared_recv(ngx_connection_t *c, u_char *buf, size_t size)
+{
+    size_t      n;
+    ngx_buf_t  *b;
+
+    if (c->udp && c->udp->closed) {
+        c->read->eof = 1;
+        return NGX_ERROR;
+    }
+
+    if (c->udp == NULL || c->udp->buffer == NULL) {
+        return NGX_AGAIN;
+    }
+
+    b = c->udp->buffer;
+    c->udp->buffer = NULL;
+
+    n = b->last - b->pos;
+
+    if (n > size) {
+        ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                      "udp datagram of %uz bytes truncated to %uz",
+                      n, size);
+        n = size;
+    }
+
+    ngx_memcpy(buf, b->pos, n);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "udp recv: fd:%d %uz", c->fd, n);
+
+    return n;
+}
+
+
+static ssize_t
+ngx_udp_shared_send(ngx_connection_t *c, u_char *buf, size_t size)
+{
+    ssize_t    n;
+    ngx_err_t  err;
+
+    if (c->udp && c->udp->closed) {
+        c->write->error = 1;
+        return NGX_ERROR;
+    }
+
+    for ( ;; ) {
+        n = sendto(c->fd, buf, size, 0, c->sockaddr, c->socklen);
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                       "sendto: fd:%d %z of %uz", c->fd, n, size);
+
+        if (n >= 0) {
+            if ((size_t) n != size) {
+                c->write->error = 1;
+                ngx_log_error(NGX_LOG_CRIT, c->log, 0,
+                              "sendto() incomplete");
+                return NGX_ERROR;
+            }
+
+            c->sent += n;
+
+            return n;
+        }
+
+        err = ngx_socket_errno;
+
+        if (err == NGX_EINTR) {
+            continue;
+        }
+
+        if (err == NGX_EAGAIN) {
+
+            /*
+             * the socket is shared with the listening connection, so
+             * the datagram is dropped instead of waiting for a write event
+             */
+
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                           "sendto() not ready, datagram dropped");
+
+            return size;
+        }
+
+        c->write->error = 1;
+
+        (void) ngx_connection_error(c, err, "sendto() failed");
+
+        return NGX_ERROR;
+    }
+}
+
+#endif
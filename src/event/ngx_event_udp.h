@@ -0,0 +1,47 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_EVENT_UDP_H_INCLUDED_
+#define _NGX_EVENT_UDP_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#if !(NGX_WIN32)
+
+#define NGX_UDP_MAX_DATAGRAM  65535
+
+#if (NGX_HAVE_RECVMMSG)
+#define NGX_UDP_BATCH         16
+#else
+#define NGX_UDP_BATCH         1
+#endif
+
+
+/*
+ * a udp session is a connection sharing the listening socket, datagrams
+ * from the same client address are passed to its read event handler
+ */
+
+struct ngx_udp_session_s {
+    ngx_rbtree_node_t   node;
+    ngx_connection_t   *connection;
+    ngx_buf_t          *buffer;
+    unsigned            closed:1;
+};
+
+
+void ngx_event_recvmsg(ngx_event_t *ev);
+void ngx_close_udp_sessions(ngx_listening_t *ls);
+void ngx_udp_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
+
+#endif
+
+
+#endif /* _NGX_EVENT_UDP_H_INCLUDED_ */
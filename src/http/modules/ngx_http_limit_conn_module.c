@@ -18,18 +18,34 @@ typedef struct {
 } ngx_http_limit_conn_node_t;
 
 
+/*
+ * a zone may be split into shards selected by the key hash, each shard
+ * is a separate slab pool with its own mutex and tree
+ */
+
 typedef struct {
-    ngx_shm_zone_t            *shm_zone;
-    ngx_rbtree_node_t         *node;
+    ngx_slab_pool_t              *shpool;
+    ngx_rbtree_t                 *rbtree;
+} ngx_http_limit_conn_shard_t;
+
+
+typedef struct {
+    ngx_shm_zone_t               *shm_zone;
+    ngx_http_limit_conn_shard_t  *shard;
+    ngx_rbtree_node_t            *node;
 } ngx_http_limit_conn_cleanup_t;
 
 
 typedef struct {
-    ngx_rbtree_t              *rbtree;
-    ngx_http_complex_value_t   key;
+    ngx_http_limit_conn_shard_t  *shards;
+    ngx_uint_t                    nshards;
+    ngx_http_complex_value_t      key;
 } ngx_http_limit_conn_ctx_t;
 
 
+#define NGX_HTTP_LIMIT_CONN_MAX_SHARDS  64
+
+
 typedef struct {
     ngx_shm_zone_t            *shm_zone;
     ngx_uint_t                 conn;
@@ -75,7 +91,7 @@ static ngx_conf_num_bounds_t  ngx_http_limit_conn_status_bounds = {
 static ngx_command_t  ngx_http_limit_conn_commands[] = {
 
     { ngx_string("limit_conn_zone"),
-      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE2,
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE23,
       ngx_http_limit_conn_zone,
       0,
       0,
@@ -151,6 +167,7 @@ ngx_http_limit_conn_handler(ngx_http_request_t *r)
     ngx_http_limit_conn_node_t     *lc;
     ngx_http_limit_conn_conf_t     *lccf;
     ngx_http_limit_conn_limit_t    *limits;
+    ngx_http_limit_conn_shard_t    *shard;
     ngx_http_limit_conn_cleanup_t  *lccln;
 
     if (r->main->limit_conn_set) {
@@ -183,11 +200,12 @@ ngx_http_limit_conn_handler(ngx_http_request_t *r)
 
         hash = ngx_crc32_short(key.data, key.len);
 
-        shpool = (ngx_slab_pool_t *) limits[i].shm_zone->shm.addr;
+        shard = &ctx->shards[hash % ctx->nshards];
+        shpool = shard->shpool;
 
         ngx_shmtx_lock(&shpool->mutex);
 
-        node = ngx_http_limit_conn_lookup(ctx->rbtree, &key, hash);
+        node = ngx_http_limit_conn_lookup(shard->rbtree, &key, hash);
 
         if (node == NULL) {
 
@@ -210,7 +228,7 @@ ngx_http_limit_conn_handler(ngx_http_request_t *r)
             lc->conn = 1;
             ngx_memcpy(lc->data, key.data, key.len);
 
-            ngx_rbtree_insert(ctx->rbtree, node);
+            ngx_rbtree_insert(shard->rbtree, node);
 
         } else {
 
@@ -246,6 +264,7 @@ ngx_http_limit_conn_handler(ngx_http_request_t *r)
         lccln = cln->data;
 
         lccln->shm_zone = limits[i].shm_zone;
+        lccln->shard = shard;
         lccln->node = node;
     }
 
@@ -340,11 +359,9 @@ ngx_http_limit_conn_cleanup(void *data)
 
     ngx_slab_pool_t             *shpool;
     ngx_rbtree_node_t           *node;
-    ngx_http_limit_conn_ctx_t   *ctx;
     ngx_http_limit_conn_node_t  *lc;
 
-    ctx = lccln->shm_zone->data;
-    shpool = (ngx_slab_pool_t *) lccln->shm_zone->shm.addr;
+    shpool = lccln->shard->shpool;
     node = lccln->node;
     lc = (ngx_http_limit_conn_node_t *) &node->color;
 
@@ -356,7 +373,7 @@ ngx_http_limit_conn_cleanup(void *data)
     lc->conn--;
 
     if (lc->conn == 0) {
-        ngx_rbtree_delete(ctx->rbtree, node);
+        ngx_rbtree_delete(lccln->shard->rbtree, node);
         ngx_slab_free_locked(shpool, node);
     }
 
@@ -385,10 +402,13 @@ ngx_http_limit_conn_init_zone(ngx_shm_zone_t *shm_zone, void *data)
 {
     ngx_http_limit_conn_ctx_t  *octx = data;
 
-    size_t                      len;
-    ngx_slab_pool_t            *shpool;
-    ngx_rbtree_node_t          *sentinel;
-    ngx_http_limit_conn_ctx_t  *ctx;
+    u_char                       *p;
+    size_t                        len, size;
+    ngx_uint_t                    i;
+    ngx_slab_pool_t              *shpool, *sp;
+    ngx_rbtree_node_t            *sentinel;
+    ngx_http_limit_conn_ctx_t    *ctx;
+    ngx_http_limit_conn_shard_t  *shard;
 
     ctx = shm_zone->data;
 
@@ -406,7 +426,15 @@ ngx_http_limit_conn_init_zone(ngx_shm_zone_t *shm_zone, void *data)
             return NGX_ERROR;
         }
 
-        ctx->rbtree = octx->rbtree;
+        if (ctx->nshards != octx->nshards) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "limit_conn_zone \"%V\" uses %ui shards "
+                          "while previously it used %ui shards",
+                          &shm_zone->shm.name, ctx->nshards, octx->nshards);
+            return NGX_ERROR;
+        }
+
+        ctx->shards = octx->shards;
 
         return NGX_OK;
     }
@@ -414,25 +442,18 @@ ngx_http_limit_conn_init_zone(ngx_shm_zone_t *shm_zone, void *data)
     shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
 
     if (shm_zone->shm.exists) {
-        ctx->rbtree = shpool->data;
+        ctx->shards = shpool->data;
 
         return NGX_OK;
     }
 
-    ctx->rbtree = ngx_slab_alloc(shpool, sizeof(ngx_rbtree_t));
-    if (ctx->rbtree == NULL) {
-        return NGX_ERROR;
-    }
-
-    shpool->data = ctx->rbtree;
-
-    sentinel = ngx_slab_alloc(shpool, sizeof(ngx_rbtree_node_t));
-    if (sentinel == NULL) {
+    ctx->shards = ngx_slab_alloc(shpool,
+                         ctx->nshards * sizeof(ngx_http_limit_conn_shard_t));
+    if (ctx->shards == NULL) {
         return NGX_ERROR;
     }
 
-    ngx_rbtree_init(ctx->rbtree, sentinel,
-                    ngx_http_limit_conn_rbtree_insert_value);
+    shpool->data = ctx->shards;
 
     len = sizeof(" in limit_conn_zone \"\"") + shm_zone->shm.name.len;
 
@@ -444,6 +465,65 @@ ngx_http_limit_conn_init_zone(ngx_shm_zone_t *shm_zone, void *data)
     ngx_sprintf(shpool->log_ctx, " in limit_conn_zone \"%V\"%Z",
                 &shm_zone->shm.name);
 
+    /* the shards share seven eighths of the zone in whole pages */
+
+    size = shm_zone->shm.size / 8 * 7 / ctx->nshards;
+    size = size / ngx_pagesize * ngx_pagesize;
+
+    if (ctx->nshards > 1 && size < 8 * ngx_pagesize) {
+        ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                      "limit_conn_zone \"%V\" is too small for %ui shards",
+                      &shm_zone->shm.name, ctx->nshards);
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->nshards; i++) {
+        shard = &ctx->shards[i];
+
+        if (ctx->nshards == 1) {
+            sp = shpool;
+
+        } else {
+            p = ngx_slab_alloc(shpool, size);
+            if (p == NULL) {
+                return NGX_ERROR;
+            }
+
+            sp = (ngx_slab_pool_t *) p;
+
+            /* the lock must not start out held */
+
+            ngx_memzero(sp, sizeof(ngx_slab_pool_t));
+
+            sp->end = p + size;
+            sp->min_shift = 3;
+            sp->addr = p;
+
+            if (ngx_shmtx_create(&sp->mutex, &sp->lock, NULL) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            ngx_slab_init(sp);
+
+            sp->log_ctx = shpool->log_ctx;
+        }
+
+        shard->shpool = sp;
+
+        shard->rbtree = ngx_slab_alloc(sp, sizeof(ngx_rbtree_t));
+        if (shard->rbtree == NULL) {
+            return NGX_ERROR;
+        }
+
+        sentinel = ngx_slab_alloc(sp, sizeof(ngx_rbtree_node_t));
+        if (sentinel == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_rbtree_init(shard->rbtree, sentinel,
+                        ngx_http_limit_conn_rbtree_insert_value);
+    }
+
     return NGX_OK;
 }
 
@@ -494,6 +574,7 @@ ngx_http_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
     u_char                            *p;
     ssize_t                            size;
+    ngx_int_t                          n;
     ngx_str_t                         *value, name, s;
     ngx_uint_t                         i;
     ngx_shm_zone_t                    *shm_zone;
@@ -517,6 +598,8 @@ ngx_http_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    ctx->nshards = 1;
+
     size = 0;
     name.len = 0;
 
@@ -556,6 +639,33 @@ ngx_http_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "shards=", 7) == 0) {
+
+            n = ngx_atoi(value[i].data + 7, value[i].len - 7);
+
+            if (n < 1 || n > NGX_HTTP_LIMIT_CONN_MAX_SHARDS) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid number of shards \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+#if !(NGX_HAVE_ATOMIC_OPS)
+
+            if (n > 1) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "\"shards\" is not supported "
+                                   "on this platform");
+                return NGX_CONF_ERROR;
+            }
+
+#endif
+
+            ctx->nshards = n;
+
+            continue;
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
@@ -10,6 +10,11 @@
 #include <ngx_http.h>
 
 
+#if (NGX_HAVE_ATOMIC_OPS && NGX_PTR_SIZE == 8)
+#define NGX_HTTP_LIMIT_REQ_APPROXIMATE  1
+#endif
+
+
 typedef struct {
     u_char                       color;
     u_char                       dummy;
@@ -23,10 +28,35 @@ typedef struct {
 } ngx_http_limit_req_node_t;
 
 
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+
+/*
+ * a slot of the approximate mode table: the key is the key hash plus one,
+ * the state packs the time of the last request in milliseconds (high half)
+ * and the excess (low half), so both are updated with a single atomic
+ * operation; the time is taken modulo 2^32 ms, so a slot left idle for
+ * about 49.7 days may be taken for a recently used one, while the clock
+ * moving backwards makes a slot look idle
+ */
+
+typedef struct {
+    ngx_atomic_t                 key;
+    ngx_atomic_t                 state;
+} ngx_http_limit_req_slot_t;
+
+#define NGX_HTTP_LIMIT_REQ_PROBES  4
+
+#endif
+
+
 typedef struct {
     ngx_rbtree_t                  rbtree;
     ngx_rbtree_node_t             sentinel;
     ngx_queue_t                   queue;
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+    ngx_http_limit_req_slot_t    *slots;
+    ngx_uint_t                    mask;
+#endif
 } ngx_http_limit_req_shctx_t;
 
 
@@ -37,6 +67,12 @@ typedef struct {
     ngx_uint_t                   rate;
     ngx_http_complex_value_t     key;
     ngx_http_limit_req_node_t   *node;
+    ngx_uint_t                   approximate; /* unsigned  approximate:1 */
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+    /* excess accounted by an approximate lookup for the current request */
+    ngx_uint_t                   excess;
+    ngx_uint_t                   pending;  /* unsigned  pending:1 */
+#endif
 } ngx_http_limit_req_ctx_t;
 
 
@@ -63,6 +99,11 @@ static ngx_msec_t ngx_http_limit_req_account(ngx_http_limit_req_limit_t *limits,
     ngx_uint_t n, ngx_uint_t *ep, ngx_http_limit_req_limit_t **limit);
 static void ngx_http_limit_req_expire(ngx_http_limit_req_ctx_t *ctx,
     ngx_uint_t n);
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+static ngx_int_t ngx_http_limit_req_lookup_approximate(
+    ngx_http_limit_req_limit_t *limit, ngx_uint_t hash, ngx_uint_t *ep,
+    ngx_uint_t account);
+#endif
 
 static void *ngx_http_limit_req_create_conf(ngx_conf_t *cf);
 static char *ngx_http_limit_req_merge_conf(ngx_conf_t *cf, void *parent,
@@ -91,7 +132,7 @@ static ngx_conf_num_bounds_t  ngx_http_limit_req_status_bounds = {
 static ngx_command_t  ngx_http_limit_req_commands[] = {
 
     { ngx_string("limit_req_zone"),
-      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE3,
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE3|NGX_CONF_TAKE4,
       ngx_http_limit_req_zone,
       0,
       0,
@@ -209,6 +250,25 @@ ngx_http_limit_req_handler(ngx_http_request_t *r)
 
         hash = ngx_crc32_short(key.data, key.len);
 
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+
+        if (ctx->approximate) {
+            rc = ngx_http_limit_req_lookup_approximate(limit, hash, &excess,
+                                             (n == lrcf->limits.nelts - 1));
+
+            ngx_log_debug4(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "limit_req[%ui]: %i %ui.%03ui",
+                           n, rc, excess / 1000, excess % 1000);
+
+            if (rc != NGX_AGAIN) {
+                break;
+            }
+
+            continue;
+        }
+
+#endif
+
         ngx_shmtx_lock(&ctx->shpool->mutex);
 
         rc = ngx_http_limit_req_lookup(limit, hash, &key, &excess,
@@ -243,6 +303,11 @@ ngx_http_limit_req_handler(ngx_http_request_t *r)
         while (n--) {
             ctx = limits[n].shm_zone->data;
 
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+            /* the approximate mode has already accounted the request */
+            ctx->pending = 0;
+#endif
+
             if (ctx->node == NULL) {
                 continue;
             }
@@ -518,6 +583,29 @@ ngx_http_limit_req_account(ngx_http_limit_req_limit_t *limits, ngx_uint_t n,
 
     while (n--) {
         ctx = limits[n].shm_zone->data;
+
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+
+        if (ctx->pending) {
+            ctx->pending = 0;
+
+            if (limits[n].nodelay) {
+                continue;
+            }
+
+            delay = ctx->excess * 1000 / ctx->rate;
+
+            if (delay > max_delay) {
+                max_delay = delay;
+                *ep = ctx->excess;
+                *limit = &limits[n];
+            }
+
+            continue;
+        }
+
+#endif
+
         lr = ctx->node;
 
         if (lr == NULL) {
@@ -631,12 +719,131 @@ ngx_http_limit_req_expire(ngx_http_limit_req_ctx_t *ctx, ngx_uint_t n)
 }
 
 
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+
+/*
+ * The approximate mode keeps the state in a fixed-size table of slots
+ * updated without the zone mutex.  Keys are identified by their hashes
+ * only, and a key that finds neither its slot nor a free or an idle one
+ * among NGX_HTTP_LIMIT_REQ_PROBES slots shares its home slot with another
+ * key, so colliding keys may be limited earlier than configured.
+ */
+
+static ngx_int_t
+ngx_http_limit_req_lookup_approximate(ngx_http_limit_req_limit_t *limit,
+    ngx_uint_t hash, ngx_uint_t *ep, ngx_uint_t account)
+{
+    uint32_t                    now, last;
+    ngx_int_t                   excess;
+    ngx_uint_t                  i, n;
+    ngx_time_t                 *tp;
+    ngx_msec_int_t              ms;
+    ngx_atomic_uint_t           key, old, state;
+    ngx_http_limit_req_ctx_t   *ctx;
+    ngx_http_limit_req_slot_t  *slot;
+
+    ctx = limit->shm_zone->data;
+
+    tp = ngx_timeofday();
+    now = (uint32_t) (tp->sec * 1000 + tp->msec);
+
+    key = (ngx_atomic_uint_t) hash + 1;
+    slot = NULL;
+
+    for (n = 0; n < NGX_HTTP_LIMIT_REQ_PROBES; n++) {
+        i = (hash + n) & ctx->sh->mask;
+
+        old = ctx->sh->slots[i].key;
+
+        if (old == key) {
+            slot = &ctx->sh->slots[i];
+            break;
+        }
+
+        if (old == 0) {
+            if (ngx_atomic_cmp_set(&ctx->sh->slots[i].key, 0, key)
+                || ctx->sh->slots[i].key == key)
+            {
+                slot = &ctx->sh->slots[i];
+                break;
+            }
+
+            continue;
+        }
+
+        /* take over a slot whose excess has been drained for a minute */
+
+        state = ctx->sh->slots[i].state;
+        last = (uint32_t) (state >> 32);
+
+        ms = (ngx_msec_int_t) (uint32_t) (now - last);
+
+        if (ms >= 60000
+            && (ngx_int_t) (state & 0xffffffff) - (ngx_int_t) ctx->rate * ms
+                                                  / 1000 <= 0
+            && ngx_atomic_cmp_set(&ctx->sh->slots[i].key, old, key))
+        {
+            slot = &ctx->sh->slots[i];
+            break;
+        }
+    }
+
+    if (slot == NULL) {
+        slot = &ctx->sh->slots[hash & ctx->sh->mask];
+    }
+
+    for ( ;; ) {
+        state = slot->state;
+        last = (uint32_t) (state >> 32);
+
+        ms = (ngx_msec_int_t) (uint32_t) (now - last);
+
+        excess = (ngx_int_t) (state & 0xffffffff)
+                 - ctx->rate * ms / 1000 + 1000;
+
+        if (excess < 0) {
+            excess = 0;
+        }
+
+        *ep = excess;
+
+        if ((ngx_uint_t) excess > limit->burst) {
+            return NGX_BUSY;
+        }
+
+        if (excess > 0xffffffff) {
+            excess = 0xffffffff;
+        }
+
+        if (ngx_atomic_cmp_set(&slot->state, state,
+                               (ngx_atomic_uint_t) now << 32 | excess))
+        {
+            break;
+        }
+    }
+
+    if (account) {
+        return NGX_OK;
+    }
+
+    ctx->excess = excess;
+    ctx->pending = 1;
+
+    return NGX_AGAIN;
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_limit_req_init_zone(ngx_shm_zone_t *shm_zone, void *data)
 {
     ngx_http_limit_req_ctx_t  *octx = data;
 
     size_t                     len;
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+    ngx_uint_t                 n;
+#endif
     ngx_http_limit_req_ctx_t  *ctx;
 
     ctx = shm_zone->data;
@@ -655,6 +862,13 @@ ngx_http_limit_req_init_zone(ngx_shm_zone_t *shm_zone, void *data)
             return NGX_ERROR;
         }
 
+        if (ctx->approximate != octx->approximate) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "limit_req \"%V\" cannot change "
+                          "the \"approximate\" mode", &shm_zone->shm.name);
+            return NGX_ERROR;
+        }
+
         ctx->sh = octx->sh;
         ctx->shpool = octx->shpool;
 
@@ -681,6 +895,35 @@ ngx_http_limit_req_init_zone(ngx_shm_zone_t *shm_zone, void *data)
 
     ngx_queue_init(&ctx->sh->queue);
 
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+
+    ctx->sh->slots = NULL;
+    ctx->sh->mask = 0;
+
+    if (ctx->approximate) {
+
+        /* leave a half of the zone to the slab allocator overhead */
+
+        for (n = 1; n * 2 * sizeof(ngx_http_limit_req_slot_t)
+                    <= shm_zone->shm.size / 2;
+             n *= 2)
+        {
+            /* void */
+        }
+
+        ctx->sh->slots = ngx_slab_alloc(ctx->shpool,
+                                        n * sizeof(ngx_http_limit_req_slot_t));
+        if (ctx->sh->slots == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memzero(ctx->sh->slots, n * sizeof(ngx_http_limit_req_slot_t));
+
+        ctx->sh->mask = n - 1;
+    }
+
+#endif
+
     len = sizeof(" in limit_req zone \"\"") + shm_zone->shm.name.len;
 
     ctx->shpool->log_ctx = ngx_slab_alloc(ctx->shpool, len);
@@ -838,6 +1081,18 @@ ngx_http_limit_req_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strcmp(value[i].data, "approximate") == 0) {
+#if (NGX_HTTP_LIMIT_REQ_APPROXIMATE)
+            ctx->approximate = 1;
+            continue;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "\"approximate\" is not supported "
+                               "on this platform");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
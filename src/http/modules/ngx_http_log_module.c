@@ -52,9 +52,37 @@ typedef struct {
     ngx_event_t                *event;
     ngx_msec_t                  flush;
     ngx_int_t                   gzip;
+
+#if (NGX_THREADS)
+    ngx_thread_pool_t          *thread_pool;
+    ngx_thread_task_t          *task;
+    ngx_chain_t                *busy;
+    ngx_chain_t                *queue;
+    ngx_chain_t               **last_queue;
+    ngx_chain_t                *free;
+    ngx_uint_t                  nbufs;
+    time_t                      disk_full_time;
+    time_t                      error_log_time;
+#endif
 } ngx_http_log_buf_t;
 
 
+#if (NGX_THREADS)
+
+typedef struct {
+    ngx_fd_t                    fd;
+    u_char                     *buf;
+    size_t                      len;
+    ngx_int_t                   gzip;
+
+    ssize_t                     n;
+    ngx_err_t                   err;
+    volatile ngx_uint_t         done;
+} ngx_http_log_thread_ctx_t;
+
+#endif
+
+
 typedef struct {
     ngx_array_t                *lengths;
     ngx_array_t                *values;
@@ -69,11 +97,43 @@ typedef struct {
     ngx_syslog_peer_t          *syslog_peer;
     ngx_http_log_fmt_t         *format;
     ngx_http_complex_value_t   *filter;
+    ngx_uint_t                  sample;     /* of NGX_HTTP_LOG_SAMPLE_ALL */
 } ngx_http_log_t;
 
 
+#define NGX_HTTP_LOG_SAMPLE_ALL  10000
+
+#define NGX_HTTP_LOG_THREAD_BUFS  8
+
+
+/*
+ * per-interval counters of requests grouped by a key,
+ * collected by each worker process separately
+ */
+
+typedef struct {
+    ngx_open_file_t            *file;
+    ngx_http_complex_value_t    key;
+    ngx_msec_t                  interval;
+    ngx_event_t                *event;
+    ngx_log_aggregate_keys_t    keys;
+} ngx_http_log_aggregate_t;
+
+
+typedef struct {
+    ngx_log_aggregate_node_t    key;
+
+    ngx_uint_t                  requests;
+    ngx_uint_t                  status[5];  /* 1xx to 5xx */
+    off_t                       bytes;
+    ngx_msec_t                  time;
+    ngx_msec_t                  time_max;
+} ngx_http_log_aggregate_node_t;
+
+
 typedef struct {
     ngx_array_t                *logs;       /* array of ngx_http_log_t */
+    ngx_array_t                *aggregates; /* of ngx_http_log_aggregate_t * */
 
     ngx_open_file_cache_t      *open_file_cache;
     time_t                      open_file_cache_valid;
@@ -105,6 +165,18 @@ static void ngx_http_log_gzip_free(void *opaque, void *address);
 
 static void ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log);
 static void ngx_http_log_flush_handler(ngx_event_t *ev);
+#if (NGX_THREADS)
+static void ngx_http_log_thread_flush(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_http_log_thread_post(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_http_log_thread_handler(void *data, ngx_log_t *log);
+static void ngx_http_log_thread_event_handler(ngx_event_t *ev);
+static void ngx_http_log_thread_done(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_http_log_thread_write(ngx_open_file_t *file, ngx_buf_t *b,
+    ngx_log_t *log);
+static void ngx_http_log_thread_error(ngx_open_file_t *file, ssize_t n,
+    ngx_err_t err, size_t len, ngx_log_t *log);
+static void ngx_http_log_thread_drain(ngx_open_file_t *file, ngx_log_t *log);
+#endif
 
 static u_char *ngx_http_log_pipe(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
@@ -126,12 +198,16 @@ static u_char *ngx_http_log_request_length(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
 
 static ngx_int_t ngx_http_log_variable_compile(ngx_conf_t *cf,
-    ngx_http_log_op_t *op, ngx_str_t *value);
+    ngx_http_log_op_t *op, ngx_str_t *value, ngx_uint_t json);
 static size_t ngx_http_log_variable_getlen(ngx_http_request_t *r,
     uintptr_t data);
 static u_char *ngx_http_log_variable(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
 static uintptr_t ngx_http_log_escape(u_char *dst, u_char *src, size_t size);
+static size_t ngx_http_log_json_variable_getlen(ngx_http_request_t *r,
+    uintptr_t data);
+static u_char *ngx_http_log_json_variable(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
 
 
 static void *ngx_http_log_create_main_conf(ngx_conf_t *cf);
@@ -146,6 +222,11 @@ static char *ngx_http_log_compile_format(ngx_conf_t *cf,
     ngx_array_t *flushes, ngx_array_t *ops, ngx_array_t *args, ngx_uint_t s);
 static char *ngx_http_log_open_file_cache(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+static ngx_int_t ngx_http_log_aggregate(ngx_http_request_t *r,
+    ngx_http_log_aggregate_t *agg);
+static void ngx_http_log_aggregate_flush_handler(ngx_event_t *ev);
+static char *ngx_http_log_set_aggregate(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static ngx_int_t ngx_http_log_init(ngx_conf_t *cf);
 
 
@@ -173,6 +254,13 @@ static ngx_command_t  ngx_http_log_commands[] = {
       0,
       NULL },
 
+    { ngx_string("log_aggregate"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_2MORE,
+      ngx_http_log_set_aggregate,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
@@ -249,12 +337,23 @@ ngx_http_log_handler(ngx_http_request_t *r)
     ngx_http_log_op_t        *op;
     ngx_http_log_buf_t       *buffer;
     ngx_http_log_loc_conf_t  *lcf;
+    ngx_http_log_aggregate_t **agg;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http log handler");
 
     lcf = ngx_http_get_module_loc_conf(r, ngx_http_log_module);
 
+    if (lcf->aggregates) {
+        agg = lcf->aggregates->elts;
+
+        for (l = 0; l < lcf->aggregates->nelts; l++) {
+            if (ngx_http_log_aggregate(r, agg[l]) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+    }
+
     if (lcf->off) {
         return NGX_OK;
     }
@@ -272,6 +371,13 @@ ngx_http_log_handler(ngx_http_request_t *r)
             }
         }
 
+        if (log[l].sample < NGX_HTTP_LOG_SAMPLE_ALL
+            && (ngx_uint_t) ngx_random() % NGX_HTTP_LOG_SAMPLE_ALL
+               >= log[l].sample)
+        {
+            continue;
+        }
+
         if (ngx_time() == log[l].disk_full_time) {
 
             /*
@@ -312,12 +418,26 @@ ngx_http_log_handler(ngx_http_request_t *r)
 
         if (buffer) {
 
+#if (NGX_THREADS)
+            if (buffer->thread_pool && ngx_time() == buffer->disk_full_time) {
+                continue;
+            }
+#endif
+
             if (len > (size_t) (buffer->last - buffer->pos)) {
 
-                ngx_http_log_write(r, &log[l], buffer->start,
-                                   buffer->pos - buffer->start);
+#if (NGX_THREADS)
+                if (buffer->thread_pool) {
+                    ngx_http_log_thread_flush(log[l].file, r->connection->log);
+
+                } else
+#endif
+                {
+                    ngx_http_log_write(r, &log[l], buffer->start,
+                                       buffer->pos - buffer->start);
 
-                buffer->pos = buffer->start;
+                    buffer->pos = buffer->start;
+                }
             }
 
             if (len <= (size_t) (buffer->last - buffer->pos)) {
@@ -706,6 +826,12 @@ ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log)
 
     buffer = file->data;
 
+#if (NGX_THREADS)
+    if (buffer->thread_pool) {
+        ngx_http_log_thread_drain(file, log);
+    }
+#endif
+
     len = buffer->pos - buffer->start;
 
     if (len == 0) {
@@ -750,20 +876,511 @@ ngx_http_log_flush_handler(ngx_event_t *ev)
     ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "http log buffer flush handler");
 
+    file = ev->data;
+    buffer = file->data;
+
     if (ev->timedout) {
-        ngx_http_log_flush(ev->data, ev->log);
+#if (NGX_THREADS)
+        if (buffer->thread_pool) {
+            ngx_http_log_thread_flush(file, ev->log);
+            return;
+        }
+#endif
+
+        ngx_http_log_flush(file, ev->log);
         return;
     }
 
     /* cancel the flush timer for graceful shutdown */
 
+    buffer->event = NULL;
+}
+
+
+static ngx_int_t
+ngx_http_log_aggregate(ngx_http_request_t *r, ngx_http_log_aggregate_t *agg)
+{
+    ngx_str_t                       key;
+    ngx_uint_t                      status;
+    ngx_time_t                     *tp;
+    ngx_msec_int_t                  ms;
+    ngx_http_log_aggregate_node_t  *node;
+
+    if (ngx_http_complex_value(r, &agg->key, &key) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (key.len == 0) {
+        return NGX_OK;
+    }
+
+    node = ngx_log_aggregate_node(&agg->keys, &key);
+    if (node == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (r->err_status) {
+        status = r->err_status;
+
+    } else {
+        status = r->headers_out.status;
+    }
+
+    node->requests++;
+
+    if (status >= 100 && status < 600) {
+        node->status[status / 100 - 1]++;
+    }
+
+    node->bytes += r->connection->sent;
+
+    tp = ngx_timeofday();
+
+    ms = (ngx_msec_int_t)
+             ((tp->sec - r->start_sec) * 1000 + (tp->msec - r->start_msec));
+    ms = ngx_max(ms, 0);
+
+    node->time += ms;
+
+    if ((ngx_msec_t) ms > node->time_max) {
+        node->time_max = ms;
+    }
+
+    if (!agg->event->timer_set) {
+        ngx_add_timer(agg->event, agg->interval);
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_log_aggregate_flush_handler(ngx_event_t *ev)
+{
+    u_char                         *buf, *p;
+    size_t                          len;
+    ssize_t                         n;
+    ngx_queue_t                    *q;
+    ngx_http_log_aggregate_t       *agg;
+    ngx_http_log_aggregate_node_t  *node;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "http log aggregate flush handler");
+
+    /* the counters are also flushed when the timer is cancelled on exit */
+
+    agg = ev->data;
+
+    if (agg->keys.pool == NULL) {
+        return;
+    }
+
+    len = 0;
+
+    for (q = ngx_queue_head(&agg->keys.queue);
+         q != ngx_queue_sentinel(&agg->keys.queue);
+         q = ngx_queue_next(q))
+    {
+        node = ngx_queue_data(q, ngx_http_log_aggregate_node_t, key.queue);
+
+        len += ngx_cached_http_log_time.len + 1
+               + node->key.sn.str.len
+               + 3 * ngx_http_log_escape(NULL, node->key.sn.str.data,
+                                         node->key.sn.str.len)
+               + sizeof(" requests= 1xx= 2xx= 3xx= 4xx= 5xx= bytes="
+                        " request_time= request_time_max=") - 1
+               + 6 * NGX_INT_T_LEN + NGX_OFF_T_LEN
+               + 2 * (NGX_TIME_T_LEN + 4) + NGX_LINEFEED_SIZE;
+    }
+
+    buf = ngx_pnalloc(agg->keys.pool, len);
+    if (buf == NULL) {
+        goto done;
+    }
+
+    p = buf;
+
+    for (q = ngx_queue_head(&agg->keys.queue);
+         q != ngx_queue_sentinel(&agg->keys.queue);
+         q = ngx_queue_next(q))
+    {
+        node = ngx_queue_data(q, ngx_http_log_aggregate_node_t, key.queue);
+
+        p = ngx_cpymem(p, ngx_cached_http_log_time.data,
+                       ngx_cached_http_log_time.len);
+        *p++ = ' ';
+
+        p = (u_char *) ngx_http_log_escape(p, node->key.sn.str.data,
+                                           node->key.sn.str.len);
+
+        p = ngx_sprintf(p, " requests=%ui 1xx=%ui 2xx=%ui 3xx=%ui 4xx=%ui"
+                        " 5xx=%ui bytes=%O request_time=%T.%03M"
+                        " request_time_max=%T.%03M",
+                        node->requests, node->status[0], node->status[1],
+                        node->status[2], node->status[3], node->status[4],
+                        node->bytes,
+                        (time_t) node->time / 1000, node->time % 1000,
+                        (time_t) node->time_max / 1000,
+                        node->time_max % 1000);
+
+        ngx_linefeed(p);
+    }
+
+    len = p - buf;
+
+    n = ngx_write_fd(agg->file->fd, buf, len);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
+                      ngx_write_fd_n " to \"%s\" failed",
+                      agg->file->name.data);
+
+    } else if ((size_t) n != len) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
+                      ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                      agg->file->name.data, n, len);
+    }
+
+done:
+
+    ngx_log_aggregate_reset(&agg->keys);
+}
+
+
+#if (NGX_THREADS)
+
+/*
+ * A buffered log with a thread pool writes full buffers from a thread.
+ * Entries are added to a free buffer meanwhile, and full buffers are
+ * queued while a write is in flight; the next one is posted when the
+ * write completes, so entries are never reordered.  Only when all
+ * NGX_HTTP_LOG_THREAD_BUFS buffers are in use the worker writes the log
+ * itself, as it does without threads; entries may then be written before
+ * those of the write in flight, which is never waited for here.
+ */
+
+static void
+ngx_http_log_thread_flush(ngx_open_file_t *file, ngx_log_t *log)
+{
+    u_char              *p;
+    size_t               len, size;
+    ngx_buf_t           *b, buf;
+    ngx_chain_t         *cl;
+    ngx_http_log_buf_t  *buffer;
+
+    buffer = file->data;
+
+    len = buffer->pos - buffer->start;
+
+    if (len == 0) {
+        return;
+    }
+
+    size = buffer->last - buffer->start;
+
+    cl = buffer->free;
+
+    if (cl) {
+        buffer->free = cl->next;
+
+    } else {
+        if (buffer->nbufs == NGX_HTTP_LOG_THREAD_BUFS) {
+            goto sync;
+        }
+
+        cl = ngx_alloc_chain_link(ngx_cycle->pool);
+        if (cl == NULL) {
+            goto sync;
+        }
+
+        b = ngx_calloc_buf(ngx_cycle->pool);
+        if (b == NULL) {
+            goto sync;
+        }
+
+        b->start = ngx_pnalloc(ngx_cycle->pool, size);
+        if (b->start == NULL) {
+            goto sync;
+        }
+
+        cl->buf = b;
+        buffer->nbufs++;
+    }
+
+    b = cl->buf;
+
+    p = b->start;
+
+    b->start = buffer->start;
+    b->pos = buffer->start;
+    b->last = buffer->pos;
+    b->end = buffer->last;
+
+    buffer->start = p;
+    buffer->pos = p;
+    buffer->last = p + size;
+
+    cl->next = NULL;
+    *buffer->last_queue = cl;
+    buffer->last_queue = &cl->next;
+
+    if (buffer->event && buffer->event->timer_set) {
+        ngx_del_timer(buffer->event);
+    }
+
+    ngx_http_log_thread_post(file, log);
+
+    return;
+
+sync:
+
+    /*
+     * the queued buffers and the current one are written by the worker,
+     * the write in flight is not waited for
+     */
+
+    while (buffer->queue) {
+        cl = buffer->queue;
+        buffer->queue = cl->next;
+
+        ngx_http_log_thread_write(file, cl->buf, log);
+
+        cl->next = buffer->free;
+        buffer->free = cl;
+    }
+
+    buffer->last_queue = &buffer->queue;
+
+    b = &buf;
+    b->pos = buffer->start;
+    b->last = buffer->pos;
+
+    ngx_http_log_thread_write(file, b, log);
+
+    buffer->pos = buffer->start;
+
+    if (buffer->event && buffer->event->timer_set) {
+        ngx_del_timer(buffer->event);
+    }
+}
+
+
+static void
+ngx_http_log_thread_post(ngx_open_file_t *file, ngx_log_t *log)
+{
+    ngx_chain_t                *cl;
+    ngx_http_log_buf_t         *buffer;
+    ngx_http_log_thread_ctx_t  *ctx;
+
+    buffer = file->data;
+    ctx = buffer->task->ctx;
+
+    /* the completion of a previous write may be not yet handled */
+
+    while (buffer->queue
+           && buffer->busy == NULL
+           && !buffer->task->event.active)
+    {
+        cl = buffer->queue;
+
+        buffer->queue = cl->next;
+        if (buffer->queue == NULL) {
+            buffer->last_queue = &buffer->queue;
+        }
+
+        ctx->fd = file->fd;
+        ctx->buf = cl->buf->pos;
+        ctx->len = cl->buf->last - cl->buf->pos;
+        ctx->gzip = buffer->gzip;
+        ctx->done = 0;
+
+        buffer->busy = cl;
+
+        if (ngx_thread_task_post(buffer->thread_pool, buffer->task)
+            == NGX_OK)
+        {
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                           "http log thread write: %uz", ctx->len);
+            return;
+        }
+
+        ngx_http_log_thread_handler(ctx, log);
+        ngx_http_log_thread_done(file, log);
+    }
+}
+
+
+static void
+ngx_http_log_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_http_log_thread_ctx_t *ctx = data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "http log thread handler");
+
+#if (NGX_ZLIB)
+    if (ctx->gzip) {
+        ctx->n = ngx_http_log_gzip(ctx->fd, ctx->buf, ctx->len, ctx->gzip, log);
+    } else {
+        ctx->n = ngx_write_fd(ctx->fd, ctx->buf, ctx->len);
+    }
+#else
+    ctx->n = ngx_write_fd(ctx->fd, ctx->buf, ctx->len);
+#endif
+
+    ctx->err = (ctx->n == -1) ? ngx_errno : 0;
+
+    ngx_memory_barrier();
+
+    ctx->done = 1;
+}
+
+
+static void
+ngx_http_log_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_open_file_t     *file;
+    ngx_http_log_buf_t  *buffer;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "http log thread write done");
+
     file = ev->data;
     buffer = file->data;
 
-    buffer->event = NULL;
+    /* the write may have been already handled while the log was drained */
+
+    if (buffer->busy) {
+        ngx_http_log_thread_done(file, ev->log);
+    }
+
+    ngx_http_log_thread_post(file, ev->log);
 }
 
 
+static void
+ngx_http_log_thread_done(ngx_open_file_t *file, ngx_log_t *log)
+{
+    ngx_chain_t                *cl;
+    ngx_http_log_buf_t         *buffer;
+    ngx_http_log_thread_ctx_t  *ctx;
+
+    buffer = file->data;
+    ctx = buffer->task->ctx;
+
+    cl = buffer->busy;
+    buffer->busy = NULL;
+
+    cl->next = buffer->free;
+    buffer->free = cl;
+
+    ngx_http_log_thread_error(file, ctx->n, ctx->err, ctx->len, log);
+}
+
+
+static void
+ngx_http_log_thread_write(ngx_open_file_t *file, ngx_buf_t *b, ngx_log_t *log)
+{
+    size_t               len;
+    ssize_t              n;
+    ngx_http_log_buf_t  *buffer;
+
+    buffer = file->data;
+
+    len = b->last - b->pos;
+
+#if (NGX_ZLIB)
+    if (buffer->gzip) {
+        n = ngx_http_log_gzip(file->fd, b->pos, len, buffer->gzip, log);
+    } else {
+        n = ngx_write_fd(file->fd, b->pos, len);
+    }
+#else
+    n = ngx_write_fd(file->fd, b->pos, len);
+#endif
+
+    ngx_http_log_thread_error(file, n, (n == -1) ? ngx_errno : 0, len, log);
+}
+
+
+static void
+ngx_http_log_thread_error(ngx_open_file_t *file, ssize_t n, ngx_err_t err,
+    size_t len, ngx_log_t *log)
+{
+    time_t               now;
+    ngx_http_log_buf_t  *buffer;
+
+    if (n == (ssize_t) len) {
+        return;
+    }
+
+    buffer = file->data;
+
+    now = ngx_time();
+
+    if (n == -1 && err == NGX_ENOSPC) {
+        buffer->disk_full_time = now;
+    }
+
+    if (now - buffer->error_log_time <= 59) {
+        return;
+    }
+
+    buffer->error_log_time = now;
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, err,
+                      ngx_write_fd_n " to \"%s\" failed",
+                      file->name.data);
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_ALERT, log, 0,
+                  ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                  file->name.data, n, len);
+}
+
+
+static void
+ngx_http_log_thread_drain(ngx_open_file_t *file, ngx_log_t *log)
+{
+    ngx_chain_t                *cl;
+    ngx_http_log_buf_t         *buffer;
+    ngx_http_log_thread_ctx_t  *ctx;
+
+    buffer = file->data;
+    ctx = buffer->task->ctx;
+
+    /* the file is going to be reopened or closed, so writes are completed */
+
+    if (buffer->busy) {
+        while (!ctx->done) {
+            ngx_msleep(1);
+        }
+
+        ngx_http_log_thread_done(file, log);
+    }
+
+    while (buffer->queue) {
+        cl = buffer->queue;
+        buffer->queue = cl->next;
+
+        ctx->fd = file->fd;
+        ctx->buf = cl->buf->pos;
+        ctx->len = cl->buf->last - cl->buf->pos;
+        ctx->gzip = buffer->gzip;
+
+        buffer->busy = cl;
+
+        ngx_http_log_thread_handler(ctx, log);
+        ngx_http_log_thread_done(file, log);
+    }
+
+    buffer->last_queue = &buffer->queue;
+}
+
+#endif
+
+
 static u_char *
 ngx_http_log_copy_short(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op)
@@ -909,7 +1526,7 @@ ngx_http_log_request_length(ngx_http_request_t *r, u_char *buf,
 
 static ngx_int_t
 ngx_http_log_variable_compile(ngx_conf_t *cf, ngx_http_log_op_t *op,
-    ngx_str_t *value)
+    ngx_str_t *value, ngx_uint_t json)
 {
     ngx_int_t  index;
 
@@ -919,8 +1536,16 @@ ngx_http_log_variable_compile(ngx_conf_t *cf, ngx_http_log_op_t *op,
     }
 
     op->len = 0;
-    op->getlen = ngx_http_log_variable_getlen;
-    op->run = ngx_http_log_variable;
+
+    if (json) {
+        op->getlen = ngx_http_log_json_variable_getlen;
+        op->run = ngx_http_log_json_variable;
+
+    } else {
+        op->getlen = ngx_http_log_variable_getlen;
+        op->run = ngx_http_log_variable;
+    }
+
     op->data = index;
 
     return NGX_OK;
@@ -1011,16 +1636,29 @@ ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
     }
 
     while (size) {
-        if (escape[*src >> 5] & (1 << (*src & 0x1f))) {
-            *dst++ = '\\';
-            *dst++ = 'x';
-            *dst++ = hex[*src >> 4];
-            *dst++ = hex[*src & 0xf];
-            src++;
 
-        } else {
-            *dst++ = *src++;
+        /* copy a run of characters that need no escaping at once */
+
+        for (n = 0; n < size; n++) {
+            if (escape[src[n] >> 5] & (1 << (src[n] & 0x1f))) {
+                break;
+            }
         }
+
+        dst = ngx_cpymem(dst, src, n);
+
+        src += n;
+        size -= n;
+
+        if (size == 0) {
+            break;
+        }
+
+        *dst++ = '\\';
+        *dst++ = 'x';
+        *dst++ = hex[*src >> 4];
+        *dst++ = hex[*src & 0xf];
+        src++;
         size--;
     }
 
@@ -1028,6 +1666,47 @@ ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
 }
 
 
+static size_t
+ngx_http_log_json_variable_getlen(ngx_http_request_t *r, uintptr_t data)
+{
+    uintptr_t                   len;
+    ngx_http_variable_value_t  *value;
+
+    value = ngx_http_get_indexed_variable(r, data);
+
+    if (value == NULL || value->not_found) {
+        return 0;
+    }
+
+    len = ngx_escape_json(NULL, value->data, value->len);
+
+    value->escape = len ? 1 : 0;
+
+    return value->len + len;
+}
+
+
+static u_char *
+ngx_http_log_json_variable(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    ngx_http_variable_value_t  *value;
+
+    value = ngx_http_get_indexed_variable(r, op->data);
+
+    if (value == NULL || value->not_found) {
+        return buf;
+    }
+
+    if (value->escape == 0) {
+        return ngx_cpymem(buf, value->data, value->len);
+
+    } else {
+        return (u_char *) ngx_escape_json(buf, value->data, value->len);
+    }
+}
+
+
 static void *
 ngx_http_log_create_main_conf(ngx_conf_t *cf)
 {
@@ -1101,6 +1780,10 @@ ngx_http_log_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         }
     }
 
+    if (conf->aggregates == NULL) {
+        conf->aggregates = prev->aggregates;
+    }
+
     if (conf->logs || conf->off) {
         return NGX_CONF_OK;
     }
@@ -1124,6 +1807,8 @@ ngx_http_log_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_memzero(log, sizeof(ngx_http_log_t));
 
+    log->sample = NGX_HTTP_LOG_SAMPLE_ALL;
+
     log->file = ngx_conf_open_file(cf->cycle, &ngx_http_access_log);
     if (log->file == NULL) {
         return NGX_CONF_ERROR;
@@ -1146,7 +1831,7 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_http_log_loc_conf_t *llcf = conf;
 
     ssize_t                            size;
-    ngx_int_t                          gzip;
+    ngx_int_t                          gzip, sample;
     ngx_uint_t                         i, n;
     ngx_msec_t                         flush;
     ngx_str_t                         *value, name, s;
@@ -1157,6 +1842,9 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_http_log_main_conf_t          *lmcf;
     ngx_http_script_compile_t          sc;
     ngx_http_compile_complex_value_t   ccv;
+#if (NGX_THREADS)
+    ngx_thread_pool_t                 *tp;
+#endif
 
     value = cf->args->elts;
 
@@ -1187,6 +1875,7 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     ngx_memzero(log, sizeof(ngx_http_log_t));
 
+    log->sample = NGX_HTTP_LOG_SAMPLE_ALL;
 
     if (ngx_strncmp(value[1].data, "syslog:", 7) == 0) {
 
@@ -1270,6 +1959,9 @@ process_formats:
     size = 0;
     flush = 0;
     gzip = 0;
+#if (NGX_THREADS)
+    tp = NULL;
+#endif
 
     for (i = 3; i < cf->args->nelts; i++) {
 
@@ -1336,6 +2028,57 @@ process_formats:
 #endif
         }
 
+        if (ngx_strncmp(value[i].data, "threads", 7) == 0
+            && (value[i].len == 7 || value[i].data[7] == '='))
+        {
+#if (NGX_THREADS)
+            if (value[i].len == 7) {
+                tp = ngx_thread_pool_add(cf, NULL);
+
+            } else {
+                s.len = value[i].len - 8;
+                s.data = value[i].data + 8;
+
+                tp = ngx_thread_pool_add(cf, &s);
+            }
+
+            if (tp == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "\"threads\" is unsupported on this platform");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
+        if (ngx_strncmp(value[i].data, "sample=", 7) == 0) {
+            s.len = value[i].len - 7;
+            s.data = value[i].data + 7;
+
+            if (s.len < 2 || s.data[s.len - 1] != '%') {
+                goto invalid_sample;
+            }
+
+            sample = ngx_atofp(s.data, s.len - 1, 2);
+
+            if (sample == NGX_ERROR || sample > NGX_HTTP_LOG_SAMPLE_ALL) {
+                goto invalid_sample;
+            }
+
+            log->sample = sample;
+
+            continue;
+
+        invalid_sample:
+
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid sample rate \"%V\"", &s);
+            return NGX_CONF_ERROR;
+        }
+
         if (ngx_strncmp(value[i].data, "if=", 3) == 0) {
             s.len = value[i].len - 3;
             s.data = value[i].data + 3;
@@ -1371,6 +2114,15 @@ process_formats:
         return NGX_CONF_ERROR;
     }
 
+#if (NGX_THREADS)
+    if (tp && size == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "no buffer is defined for access_log \"%V\"",
+                           &value[1]);
+        return NGX_CONF_ERROR;
+    }
+#endif
+
     if (size) {
 
         if (log->script) {
@@ -1390,7 +2142,11 @@ process_formats:
 
             if (buffer->last - buffer->start != size
                 || buffer->flush != flush
-                || buffer->gzip != gzip)
+                || buffer->gzip != gzip
+#if (NGX_THREADS)
+                || buffer->thread_pool != tp
+#endif
+               )
             {
                 ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                                    "access_log \"%V\" already defined "
@@ -1431,6 +2187,25 @@ process_formats:
 
         buffer->gzip = gzip;
 
+#if (NGX_THREADS)
+        if (tp) {
+            buffer->last_queue = &buffer->queue;
+
+            buffer->task = ngx_thread_task_alloc(cf->pool,
+                                          sizeof(ngx_http_log_thread_ctx_t));
+            if (buffer->task == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            buffer->task->handler = ngx_http_log_thread_handler;
+            buffer->task->event.handler = ngx_http_log_thread_event_handler;
+            buffer->task->event.data = log->file;
+            buffer->task->event.log = &cf->cycle->new_log;
+
+            buffer->thread_pool = tp;
+        }
+#endif
+
         log->file->flush = ngx_http_log_flush;
         log->file->data = buffer;
     }
@@ -1491,12 +2266,28 @@ ngx_http_log_compile_format(ngx_conf_t *cf, ngx_array_t *flushes,
     size_t               i, len;
     ngx_str_t           *value, var;
     ngx_int_t           *flush;
-    ngx_uint_t           bracket;
+    ngx_uint_t           bracket, json;
     ngx_http_log_op_t   *op;
     ngx_http_log_var_t  *v;
 
+    json = 0;
     value = args->elts;
 
+    if (s < args->nelts && ngx_strncmp(value[s].data, "escape=", 7) == 0) {
+        data = value[s].data + 7;
+
+        if (ngx_strcmp(data, "json") == 0) {
+            json = 1;
+
+        } else if (ngx_strcmp(data, "default") != 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "unknown log format escaping \"%s\"", data);
+            return NGX_CONF_ERROR;
+        }
+
+        s++;
+    }
+
     for ( /* void */ ; s < args->nelts; s++) {
 
         i = 0;
@@ -1575,7 +2366,9 @@ ngx_http_log_compile_format(ngx_conf_t *cf, ngx_array_t *flushes,
                     }
                 }
 
-                if (ngx_http_log_variable_compile(cf, op, &var) != NGX_OK) {
+                if (ngx_http_log_variable_compile(cf, op, &var, json)
+                    != NGX_OK)
+                {
                     return NGX_CONF_ERROR;
                 }
 
@@ -1749,6 +2542,113 @@ ngx_http_log_open_file_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_http_log_set_aggregate(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_log_loc_conf_t *llcf = conf;
+
+    ngx_str_t                         *value, s;
+    ngx_uint_t                         i;
+    ngx_http_log_aggregate_t          *agg, **aggp;
+    ngx_http_compile_complex_value_t   ccv;
+
+    value = cf->args->elts;
+
+    if (llcf->aggregates == NULL) {
+        llcf->aggregates = ngx_array_create(cf->pool, 1,
+                                           sizeof(ngx_http_log_aggregate_t *));
+        if (llcf->aggregates == NULL) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    agg = ngx_pcalloc(cf->pool, sizeof(ngx_http_log_aggregate_t));
+    if (agg == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    aggp = ngx_array_push(llcf->aggregates);
+    if (aggp == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    *aggp = agg;
+
+    agg->file = ngx_conf_open_file(cf->cycle, &value[1]);
+    if (agg->file == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_memzero(&ccv, sizeof(ngx_http_compile_complex_value_t));
+
+    ccv.cf = cf;
+    ccv.value = &value[2];
+    ccv.complex_value = &agg->key;
+
+    if (ngx_http_compile_complex_value(&ccv) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    agg->interval = 60000;
+    agg->keys.max_keys = NGX_LOG_AGGREGATE_KEYS;
+    agg->keys.size = sizeof(ngx_http_log_aggregate_node_t);
+
+    for (i = 3; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "interval=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            agg->interval = ngx_parse_time(&s, 0);
+
+            if (agg->interval == (ngx_msec_t) NGX_ERROR
+                || agg->interval == 0)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid interval \"%V\"", &s);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "keys=", 5) == 0) {
+
+            agg->keys.max_keys = ngx_atoi(value[i].data + 5,
+                                          value[i].len - 5);
+
+            if (agg->keys.max_keys == (ngx_uint_t) NGX_ERROR
+                || agg->keys.max_keys == 0)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid number of keys \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    agg->event = ngx_pcalloc(cf->pool, sizeof(ngx_event_t));
+    if (agg->event == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    agg->event->data = agg;
+    agg->event->handler = ngx_http_log_aggregate_flush_handler;
+    agg->event->log = &cf->cycle->new_log;
+    agg->event->cancelable = 1;
+
+    return NGX_CONF_OK;
+}
+
+
 static ngx_int_t
 ngx_http_log_init(ngx_conf_t *cf)
 {
@@ -21,6 +21,7 @@ typedef struct {
 
     ngx_array_t                *values_hash;
     ngx_array_t                 var_values;
+    ngx_array_t                 prefixes;
 #if (NGX_PCRE)
     ngx_array_t                 regexes;
 #endif
@@ -171,8 +172,10 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     char                              *rv;
     ngx_str_t                         *value, name;
+    ngx_uint_t                         i;
     ngx_conf_t                         save;
     ngx_pool_t                        *pool;
+    ngx_hash_key_t                    *prefix;
     ngx_hash_init_t                    hash;
     ngx_http_map_ctx_t                *map;
     ngx_http_variable_t               *var;
@@ -254,6 +257,13 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    if (ngx_array_init(&ctx.prefixes, pool, 2, sizeof(ngx_hash_key_t))
+        != NGX_OK)
+    {
+        ngx_destroy_pool(pool);
+        return NGX_CONF_ERROR;
+    }
+
 #if (NGX_PCRE)
     if (ngx_array_init(&ctx.regexes, cf->pool, 2, sizeof(ngx_http_map_regex_t))
         != NGX_OK)
@@ -345,11 +355,75 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         map->map.hash.wc_tail = (ngx_hash_wildcard_t *) hash.hash;
     }
 
+    if (ctx.prefixes.nelts) {
+
+        ngx_qsort(ctx.prefixes.elts, (size_t) ctx.prefixes.nelts,
+                  sizeof(ngx_hash_key_t), ngx_trie_cmp_keys);
+
+        prefix = ctx.prefixes.elts;
+
+        for (i = 1; i < ctx.prefixes.nelts; i++) {
+            if (prefix[i].key.len == prefix[i - 1].key.len
+                && ngx_strncmp(prefix[i].key.data, prefix[i - 1].key.data,
+                               prefix[i].key.len)
+                   == 0)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "conflicting parameter \"^~%V\"",
+                                   &prefix[i].key);
+                ngx_destroy_pool(pool);
+                return NGX_CONF_ERROR;
+            }
+        }
+
+        if (ngx_trie_init(&map->map.prefix, cf->pool, pool, prefix,
+                          ctx.prefixes.nelts)
+            != NGX_OK)
+        {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
+    }
+
 #if (NGX_PCRE)
 
     if (ctx.regexes.nelts) {
         map->map.regex = ctx.regexes.elts;
         map->map.nregex = ctx.regexes.nelts;
+
+#if (NGX_REGEX_SET)
+
+        if (ctx.regexes.nelts > 1) {
+            ngx_str_t             *patterns;
+            ngx_regex_t          **regexes;
+            ngx_http_map_regex_t  *reg;
+
+            patterns = ngx_palloc(pool, ctx.regexes.nelts * sizeof(ngx_str_t));
+            if (patterns == NULL) {
+                ngx_destroy_pool(pool);
+                return NGX_CONF_ERROR;
+            }
+
+            regexes = ngx_palloc(pool,
+                                 ctx.regexes.nelts * sizeof(ngx_regex_t *));
+            if (regexes == NULL) {
+                ngx_destroy_pool(pool);
+                return NGX_CONF_ERROR;
+            }
+
+            reg = ctx.regexes.elts;
+
+            for (i = 0; i < ctx.regexes.nelts; i++) {
+                patterns[i] = reg[i].regex->name;
+                regexes[i] = reg[i].regex->regex;
+            }
+
+            map->map.regex_set = ngx_regex_set_compile(cf->pool, regexes,
+                                                       patterns,
+                                                       ctx.regexes.nelts);
+        }
+
+#endif
     }
 
 #endif
@@ -378,6 +452,7 @@ ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf)
     ngx_int_t                   rv, index;
     ngx_str_t                  *value, name;
     ngx_uint_t                  i, key;
+    ngx_hash_key_t             *prefix;
     ngx_http_map_conf_ctx_t    *ctx;
     ngx_http_variable_value_t  *var, **vp;
 
@@ -541,6 +616,23 @@ found:
 
 #endif
 
+    if (value[0].len > 1 && value[0].data[0] == '^' && value[0].data[1] == '~')
+    {
+        prefix = ngx_array_push(&ctx->prefixes);
+        if (prefix == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        prefix->key.len = value[0].len - 2;
+        prefix->key.data = value[0].data + 2;
+        prefix->key_hash = 0;
+        prefix->value = var;
+
+        ngx_strlow(prefix->key.data, prefix->key.data, prefix->key.len);
+
+        return NGX_CONF_OK;
+    }
+
     if (value[0].len && value[0].data[0] == '\\') {
         value[0].len--;
         value[0].data++;
@@ -20,6 +20,8 @@ typedef struct {
     ngx_ssl_t                       ssl;
 
     ngx_flag_t                      prefer_server_ciphers;
+    ngx_flag_t                      async;
+    ngx_flag_t                      ktls;
 
     ngx_uint_t                      protocols;
 
@@ -28,6 +30,11 @@ typedef struct {
 
     size_t                          buffer_size;
 
+    ngx_flag_t                      dyn_rec_enable;
+    ngx_msec_t                      dyn_rec_timeout;
+    size_t                          dyn_rec_size_lo;
+    ngx_uint_t                      dyn_rec_threshold;
+
     ssize_t                         builtin_session_cache;
 
     time_t                          session_timeout;
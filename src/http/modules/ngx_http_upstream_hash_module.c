@@ -25,6 +25,7 @@ typedef struct {
 typedef struct {
     ngx_http_complex_value_t            key;
     ngx_http_upstream_chash_points_t   *points;
+    ngx_uint_t                          bound;
 } ngx_http_upstream_hash_srv_conf_t;
 
 
@@ -66,7 +67,7 @@ static char *ngx_http_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd,
 static ngx_command_t  ngx_http_upstream_hash_commands[] = {
 
     { ngx_string("hash"),
-      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE12,
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE123,
       ngx_http_upstream_hash,
       NGX_HTTP_SRV_CONF_OFFSET,
       0,
@@ -488,7 +489,7 @@ ngx_http_upstream_get_chash_peer(ngx_peer_connection_t *pc, void *data)
     intptr_t                            m;
     ngx_str_t                          *server;
     ngx_int_t                           total;
-    ngx_uint_t                          i, n, best_i;
+    ngx_uint_t                          i, n, best_i, bound, load;
     ngx_http_upstream_rr_peer_t        *peer, *best;
     ngx_http_upstream_chash_point_t    *point;
     ngx_http_upstream_chash_points_t   *points;
@@ -508,6 +509,20 @@ ngx_http_upstream_get_chash_peer(ngx_peer_connection_t *pc, void *data)
     points = hcf->points;
     point = &points->point[0];
 
+    /*
+     * with bounded loads, a peer may not take more than bound/100 of
+     * its weighted share of the in-flight requests, including this one
+     */
+
+    bound = hcf->bound;
+    load = 0;
+
+    if (bound) {
+        for (peer = hp->rrp.peers->peer; peer; peer = peer->next) {
+            load += peer->conns;
+        }
+    }
+
     for ( ;; ) {
         server = point[hp->hash % points->number].server;
 
@@ -549,6 +564,13 @@ ngx_http_upstream_get_chash_peer(ngx_peer_connection_t *pc, void *data)
                 continue;
             }
 
+            if (bound
+                && peer->conns * hp->rrp.peers->total_weight * 100
+                   >= bound * (load + 1) * peer->weight)
+            {
+                continue;
+            }
+
             peer->current_weight += peer->effective_weight;
             total += peer->effective_weight;
 
@@ -571,6 +593,14 @@ ngx_http_upstream_get_chash_peer(ngx_peer_connection_t *pc, void *data)
         hp->tries++;
 
         if (hp->tries >= points->number) {
+
+            if (bound) {
+                /* no usable peer is under the bound, ignore it */
+                bound = 0;
+                hp->tries = 0;
+                continue;
+            }
+
             ngx_http_upstream_rr_peers_unlock(hp->rrp.peers);
             return NGX_BUSY;
         }
@@ -612,6 +642,7 @@ ngx_http_upstream_hash_create_conf(ngx_conf_t *cf)
     }
 
     conf->points = NULL;
+    conf->bound = 0;
 
     return conf;
 }
@@ -622,6 +653,7 @@ ngx_http_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
     ngx_http_upstream_hash_srv_conf_t  *hcf = conf;
 
+    ngx_int_t                          bound;
     ngx_str_t                         *value;
     ngx_http_upstream_srv_conf_t      *uscf;
     ngx_http_compile_complex_value_t   ccv;
@@ -664,5 +696,32 @@ ngx_http_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    hcf->bound = 0;
+
+    if (cf->args->nelts < 4) {
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strcmp(value[3].data, "bounded") == 0) {
+        hcf->bound = 125;
+
+    } else if (ngx_strncmp(value[3].data, "bounded=", 8) == 0) {
+
+        bound = ngx_atofp(value[3].data + 8, value[3].len - 8, 2);
+
+        if (bound == NGX_ERROR || bound <= 100) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid load bound \"%V\"", &value[3]);
+            return NGX_CONF_ERROR;
+        }
+
+        hcf->bound = bound;
+
+    } else {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[3]);
+        return NGX_CONF_ERROR;
+    }
+
     return NGX_CONF_OK;
 }
@@ -227,6 +227,9 @@ static void ngx_http_create_locations_list(ngx_queue_t *locations,
 static ngx_http_location_tree_node_t *
     ngx_http_create_locations_tree(ngx_conf_t *cf, ngx_queue_t *locations,
     size_t prefix);
+static ngx_http_location_tree_node_t *
+    ngx_http_compact_locations_tree(ngx_conf_t *cf,
+    ngx_http_location_tree_node_t *root);
 
 static ngx_int_t ngx_http_optimize_servers(ngx_conf_t *cf,
     ngx_http_core_main_conf_t *cmcf, ngx_array_t *ports);
@@ -1541,6 +1544,11 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
     ngx_uint_t                   r;
     ngx_queue_t                 *regex;
 #endif
+#if (NGX_REGEX_SET)
+    ngx_uint_t                   i;
+    ngx_str_t                   *patterns;
+    ngx_regex_t                **regexes;
+#endif
 
     locations = pclcf->locations;
 
@@ -1668,6 +1676,32 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
 
         // 把正则匹配的location分离出去
         ngx_queue_split(locations, regex, &tail);
+
+#if (NGX_REGEX_SET)
+
+        if (r > 1) {
+            patterns = ngx_palloc(cf->temp_pool, r * sizeof(ngx_str_t));
+            if (patterns == NULL) {
+                return NGX_ERROR;
+            }
+
+            regexes = ngx_palloc(cf->temp_pool, r * sizeof(ngx_regex_t *));
+            if (regexes == NULL) {
+                return NGX_ERROR;
+            }
+
+            clcfp = pclcf->regex_locations;
+
+            for (i = 0; i < r; i++) {
+                patterns[i] = clcfp[i]->regex->name;
+                regexes[i] = clcfp[i]->regex->regex;
+            }
+
+            pclcf->regex_set = ngx_regex_set_compile(cf->pool, regexes,
+                                                     patterns, r);
+        }
+
+#endif
     }
 
 #endif
@@ -1697,9 +1731,10 @@ static ngx_int_t
 ngx_http_init_static_location_trees(ngx_conf_t *cf,
     ngx_http_core_loc_conf_t *pclcf)
 {
-    ngx_queue_t                *q, *locations;
-    ngx_http_core_loc_conf_t   *clcf;
-    ngx_http_location_queue_t  *lq;
+    ngx_queue_t                    *q, *locations;
+    ngx_http_core_loc_conf_t       *clcf;
+    ngx_http_location_queue_t      *lq;
+    ngx_http_location_tree_node_t  *tree;
 
     /*
      * 取出pclcf下的locations队列,此时的队列并没有包含全部的location{},只包括  =|^~|无修饰符 这三种类型的locaiton
@@ -1739,7 +1774,12 @@ ngx_http_init_static_location_trees(ngx_conf_t *cf,
     ngx_http_create_locations_list(locations, ngx_queue_head(locations));
 
     // 创建完全二叉树
-    pclcf->static_locations = ngx_http_create_locations_tree(cf, locations, 0);
+    tree = ngx_http_create_locations_tree(cf, locations, 0);
+    if (tree == NULL) {
+        return NGX_ERROR;
+    }
+
+    pclcf->static_locations = ngx_http_compact_locations_tree(cf, tree);
     if (pclcf->static_locations == NULL) {
         return NGX_ERROR;
     }
@@ -2095,7 +2135,7 @@ ngx_http_create_locations_tree(ngx_conf_t *cf, ngx_queue_t *locations,
     lq = (ngx_http_location_queue_t *) q;
     len = lq->name->len - prefix;
 
-    node = ngx_palloc(cf->pool,
+    node = ngx_palloc(cf->temp_pool,
                       offsetof(ngx_http_location_tree_node_t, name) + len);
     if (node == NULL) {
         return NULL;
@@ -2155,6 +2195,117 @@ inclusive:
 }
 
 
+/*
+ * copies the tree built in the temporary pool into a single cache line
+ * aligned block, nodes are laid out breadth-first, so the upper levels
+ * that are tested by every request share the first cache lines
+ */
+
+static ngx_http_location_tree_node_t *
+ngx_http_compact_locations_tree(ngx_conf_t *cf,
+    ngx_http_location_tree_node_t *root)
+{
+    u_char                          *p;
+    size_t                           size;
+    ngx_uint_t                       i, n;
+    ngx_array_t                      queue;
+    ngx_http_location_tree_node_t   *node, **nodes, **compact;
+
+    if (ngx_array_init(&queue, cf->temp_pool, 16,
+                       sizeof(ngx_http_location_tree_node_t *))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    nodes = ngx_array_push(&queue);
+    if (nodes == NULL) {
+        return NULL;
+    }
+
+    *nodes = root;
+    size = 0;
+
+    for (i = 0; i < queue.nelts; i++) {
+        node = ((ngx_http_location_tree_node_t **) queue.elts)[i];
+
+        size += ngx_align(offsetof(ngx_http_location_tree_node_t, name)
+                          + node->len, sizeof(void *));
+
+        if (node->left) {
+            nodes = ngx_array_push(&queue);
+            if (nodes == NULL) {
+                return NULL;
+            }
+
+            *nodes = node->left;
+        }
+
+        if (node->right) {
+            nodes = ngx_array_push(&queue);
+            if (nodes == NULL) {
+                return NULL;
+            }
+
+            *nodes = node->right;
+        }
+
+        if (node->tree) {
+            nodes = ngx_array_push(&queue);
+            if (nodes == NULL) {
+                return NULL;
+            }
+
+            *nodes = node->tree;
+        }
+    }
+
+    nodes = queue.elts;
+
+    compact = ngx_palloc(cf->temp_pool,
+                         queue.nelts * sizeof(ngx_http_location_tree_node_t *));
+    if (compact == NULL) {
+        return NULL;
+    }
+
+    p = ngx_pmemalign(cf->pool, size, ngx_cacheline_size);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < queue.nelts; i++) {
+        size = offsetof(ngx_http_location_tree_node_t, name) + nodes[i]->len;
+
+        compact[i] = (ngx_http_location_tree_node_t *) p;
+        ngx_memcpy(p, nodes[i], size);
+
+        p += ngx_align(size, sizeof(void *));
+    }
+
+    /* the children are queued in the same order as they are linked here */
+
+    n = 1;
+
+    for (i = 0; i < queue.nelts; i++) {
+        node = nodes[i];
+
+        if (node->left) {
+            compact[i]->left = compact[n++];
+        }
+
+        if (node->right) {
+            compact[i]->right = compact[n++];
+        }
+
+        if (node->tree) {
+            compact[i]->tree = compact[n++];
+        }
+    }
+
+    return compact[0];
+}
+
+
 ngx_int_t
 ngx_http_add_listen(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
     ngx_http_listen_opt_t *lsopt)
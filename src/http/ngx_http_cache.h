@@ -50,7 +50,8 @@ typedef struct {
     unsigned                         exists:1;
     unsigned                         updating:1;
     unsigned                         deleting:1;
-                                     /* 11 unused bits */
+    unsigned                         waiting:1;
+                                     /* 10 unused bits */
 
     ngx_file_uniq_t                  uniq;
     time_t                           expire;
@@ -101,6 +102,7 @@ struct ngx_http_cache_s {
     ngx_msec_t                       wait_time;
 
     ngx_event_t                      wait_event;
+    ngx_queue_t                      wait_queue;
 
     unsigned                         lock:1;
     unsigned                         waiting:1;
@@ -111,6 +113,7 @@ struct ngx_http_cache_s {
     unsigned                         temp_file:1;
     unsigned                         reading:1;
     unsigned                         secondary:1;
+    unsigned                         background:1;
 };
 
 
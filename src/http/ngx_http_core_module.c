@@ -1801,6 +1801,9 @@ ngx_http_core_find_location(ngx_http_request_t *r)
     ngx_int_t                  n;
     ngx_uint_t                 noregex;
     ngx_http_core_loc_conf_t  *clcf, **clcfp;
+#if (NGX_REGEX_SET)
+    ngx_int_t                  first;
+#endif
 
     noregex = 0;
 #endif
@@ -1845,8 +1848,34 @@ ngx_http_core_find_location(ngx_http_request_t *r)
 
     if (noregex == 0 && pclcf->regex_locations) {
 
+#if (NGX_REGEX_SET)
+
+        if (pclcf->regex_set) {
+            first = ngx_regex_set_exec(pclcf->regex_set, &r->uri);
+
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "test location regex set: %i", first);
+
+            if (first == NGX_DECLINED) {
+                return rc;
+            }
+
+        } else {
+            first = 0;
+        }
+
+#endif
+
         for (clcfp = pclcf->regex_locations; *clcfp; clcfp++) {
 
+#if (NGX_REGEX_SET)
+            if (ngx_regex_set_skip(pclcf->regex_set,
+                                   clcfp - pclcf->regex_locations, first))
+            {
+                continue;
+            }
+#endif
+
             ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "test location: ~ \"%V\"", &(*clcfp)->name);
 
@@ -1875,6 +1904,36 @@ ngx_http_core_find_location(ngx_http_request_t *r)
 }
 
 
+/*
+ * the common part of the uri and the location name is skipped a word
+ * at a time, and ngx_filename_cmp() orders the first differing bytes;
+ * location names never contain null bytes, so the result is the same
+ */
+
+static ngx_inline ngx_int_t
+ngx_http_core_location_cmp(u_char *uri, u_char *name, size_t n)
+{
+#if !(NGX_HAVE_CASELESS_FILESYSTEM)
+    uint64_t  w1, w2;
+
+    while (n >= sizeof(uint64_t)) {
+        ngx_memcpy(&w1, uri, sizeof(uint64_t));
+        ngx_memcpy(&w2, name, sizeof(uint64_t));
+
+        if (w1 != w2) {
+            break;
+        }
+
+        uri += sizeof(uint64_t);
+        name += sizeof(uint64_t);
+        n -= sizeof(uint64_t);
+    }
+#endif
+
+    return ngx_filename_cmp(uri, name, n);
+}
+
+
 /*
  * NGX_OK  0     - exact match 精确匹配(=)
  * NGX_DONE  -4    - auto redirect 表示location结尾是“/”符号, 比如“/a/ {}” 但请求是“/a”
@@ -1908,7 +1967,7 @@ ngx_http_core_find_static_location(ngx_http_request_t *r,
         n = (len <= (size_t) node->len) ? len : node->len;
 
         // 当前uri和容器中的节点比对,只比对两者中最短的字符个数
-        rc = ngx_filename_cmp(uri, node->name, n);
+        rc = ngx_http_core_location_cmp(uri, node->name, n);
 
         /*
          * 比对不成功,比如:
@@ -2894,6 +2953,7 @@ ngx_http_subrequest(ngx_http_request_t *r,
     sr->subrequest_in_memory = (flags & NGX_HTTP_SUBREQUEST_IN_MEMORY) != 0;
     // TODO
     sr->waited = (flags & NGX_HTTP_SUBREQUEST_WAITED) != 0;
+    sr->background = (flags & NGX_HTTP_SUBREQUEST_BACKGROUND) != 0;
 
     // 未解析的rui
     sr->unparsed_uri = r->unparsed_uri;
@@ -2919,6 +2979,26 @@ ngx_http_subrequest(ngx_http_request_t *r,
      */
     sr->write_event_handler = ngx_http_handler;
 
+    if (flags & NGX_HTTP_SUBREQUEST_CLONE) {
+        sr->method = r->method;
+        sr->method_name = r->method_name;
+        sr->loc_conf = r->loc_conf;
+        sr->valid_location = r->valid_location;
+        sr->content_handler = r->content_handler;
+        sr->phase_handler = r->phase_handler;
+        sr->write_event_handler = ngx_http_core_run_phases;
+
+        ngx_http_update_location_config(sr);
+    }
+
+    sr->variables = r->variables;
+
+    sr->log_handler = r->log_handler;
+
+    if (sr->background) {
+        goto post;
+    }
+
     /*
      * 这一步用来确定子请求sr是否可以成为向客户端输出数据的请求
      */
@@ -2982,10 +3062,6 @@ ngx_http_subrequest(ngx_http_request_t *r,
         c->data = sr;
     }
 
-    sr->variables = r->variables;
-
-    sr->log_handler = r->log_handler;
-
     /**
      * 每个子请求都要至少创建一个这个对象，表示本请求、本请求下的子请求或数据节点？
      */
@@ -3007,6 +3083,8 @@ ngx_http_subrequest(ngx_http_request_t *r,
         r->postponed = pr;
     }
 
+post:
+
     // 内部请求
     sr->internal = 1;
 
@@ -743,6 +743,9 @@ struct ngx_http_core_loc_conf_s {
 #if (NGX_PCRE)
     // 存放正则匹配的location
     ngx_http_core_loc_conf_t       **regex_locations;
+#if (NGX_REGEX_SET)
+    ngx_regex_set_t                 *regex_set;
+#endif
 #endif
 
     /*
@@ -16,6 +16,11 @@ static ngx_int_t ngx_http_file_cache_lock(ngx_http_request_t *r,
 static void ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev);
 static void ngx_http_file_cache_lock_wait(ngx_http_request_t *r,
     ngx_http_cache_t *c);
+static void ngx_http_file_cache_lock_wakeup(ngx_http_file_cache_t *cache,
+    u_char *key);
+#if !(NGX_WIN32)
+static void ngx_http_file_cache_wakeup_handler(ngx_cycle_t *cycle);
+#endif
 static ngx_int_t ngx_http_file_cache_read(ngx_http_request_t *r,
     ngx_http_cache_t *c);
 static ssize_t ngx_http_file_cache_aio_read(ngx_http_request_t *r,
@@ -78,6 +83,11 @@ ngx_str_t  ngx_http_cache_status[] = {
 static u_char  ngx_http_file_cache_key[] = { LF, 'K', 'E', 'Y', ':', ' ' };
 
 
+/* requests of this worker waiting for a cache lock */
+
+static ngx_queue_t  ngx_http_file_cache_waiters;
+
+
 static ngx_int_t
 ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
@@ -418,6 +428,9 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
         c->node->lock_time = now + c->lock_age;
         c->updating = 1;
         c->lock_time = c->node->lock_time;
+
+    } else if (c->lock_timeout) {
+        c->node->waiting = 1;
     }
 
     ngx_shmtx_unlock(&cache->shpool->mutex);
@@ -436,6 +449,8 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
 
     c->waiting = 1;
 
+    ngx_queue_insert_tail(&ngx_http_file_cache_waiters, &c->wait_queue);
+
     if (c->wait_time == 0) {
         c->wait_time = now + c->lock_timeout;
 
@@ -500,6 +515,7 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
     timer = c->node->lock_time - now;
 
     if (c->node->updating && (ngx_msec_int_t) timer > 0) {
+        c->node->waiting = 1;
         wait = 1;
     }
 
@@ -513,11 +529,77 @@ ngx_http_file_cache_lock_wait(ngx_http_request_t *r, ngx_http_cache_t *c)
 wakeup:
 
     c->waiting = 0;
+    ngx_queue_remove(&c->wait_queue);
+
     r->main->blocked--;
     r->write_event_handler(r);
 }
 
 
+static void
+ngx_http_file_cache_lock_wakeup(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_queue_t       *q;
+    ngx_http_cache_t  *c;
+
+    /*
+     * the lock was released: wake up waiters of this worker at once
+     * and ask other workers to recheck their waiters
+     */
+
+    for (q = ngx_queue_head(&ngx_http_file_cache_waiters);
+         q != ngx_queue_sentinel(&ngx_http_file_cache_waiters);
+         q = ngx_queue_next(q))
+    {
+        c = ngx_queue_data(q, ngx_http_cache_t, wait_queue);
+
+        if (c->file_cache != cache
+            || ngx_memcmp(c->key, key, NGX_HTTP_CACHE_KEY_LEN) != 0)
+        {
+            continue;
+        }
+
+        if (c->wait_event.timer_set) {
+            ngx_del_timer(&c->wait_event);
+        }
+
+        ngx_post_event(&c->wait_event, &ngx_posted_events);
+    }
+
+#if !(NGX_WIN32)
+    ngx_wakeup_worker_processes((ngx_cycle_t *) ngx_cycle);
+#endif
+}
+
+
+#if !(NGX_WIN32)
+
+static void
+ngx_http_file_cache_wakeup_handler(ngx_cycle_t *cycle)
+{
+    ngx_queue_t       *q;
+    ngx_http_cache_t  *c;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cycle->log, 0,
+                   "http file cache wakeup");
+
+    for (q = ngx_queue_head(&ngx_http_file_cache_waiters);
+         q != ngx_queue_sentinel(&ngx_http_file_cache_waiters);
+         q = ngx_queue_next(q))
+    {
+        c = ngx_queue_data(q, ngx_http_cache_t, wait_queue);
+
+        if (c->wait_event.timer_set) {
+            ngx_del_timer(&c->wait_event);
+        }
+
+        ngx_post_event(&c->wait_event, &ngx_posted_events);
+    }
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
@@ -1325,6 +1407,7 @@ ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
 {
     off_t                   fs_size;
     ngx_int_t               rc;
+    ngx_uint_t              wakeup;
     ngx_file_uniq_t         uniq;
     ngx_file_info_t         fi;
     ngx_http_cache_t        *c;
@@ -1390,7 +1473,14 @@ ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
 
     c->node->updating = 0;
 
+    wakeup = c->node->waiting;
+    c->node->waiting = 0;
+
     ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    if (wakeup) {
+        ngx_http_file_cache_lock_wakeup(cache, c->key);
+    }
 }
 
 
@@ -1580,6 +1670,7 @@ ngx_http_cache_send(ngx_http_request_t *r)
 void
 ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 {
+    ngx_uint_t                   wakeup;
     ngx_http_file_cache_t       *cache;
     ngx_http_file_cache_node_t  *fcn;
 
@@ -1597,8 +1688,13 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
     fcn = c->node;
     fcn->count--;
 
+    wakeup = 0;
+
     if (c->updating && fcn->lock_time == c->lock_time) {
         fcn->updating = 0;
+
+        wakeup = fcn->waiting;
+        fcn->waiting = 0;
     }
 
     if (c->error) {
@@ -1635,9 +1731,22 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
         }
     }
 
+    if (c->waiting) {
+        c->waiting = 0;
+        ngx_queue_remove(&c->wait_queue);
+    }
+
     if (c->wait_event.timer_set) {
         ngx_del_timer(&c->wait_event);
     }
+
+    if (c->wait_event.posted) {
+        ngx_delete_posted_event(&c->wait_event);
+    }
+
+    if (wakeup) {
+        ngx_http_file_cache_lock_wakeup(cache, c->key);
+    }
 }
 
 
@@ -1653,7 +1762,7 @@ ngx_http_file_cache_cleanup(void *data)
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
                    "http file cache cleanup");
 
-    if (c->updating) {
+    if (c->updating && !c->background) {
         ngx_log_error(NGX_LOG_ALERT, c->file.log, 0,
                       "stalled cache updating, error:%ui", c->error);
     }
@@ -2170,6 +2279,12 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    ngx_queue_init(&ngx_http_file_cache_waiters);
+
+#if !(NGX_WIN32)
+    ngx_wakeup_handler = ngx_http_file_cache_wakeup_handler;
+#endif
+
     cache->path = ngx_pcalloc(cf->pool, sizeof(ngx_path_t));
     if (cache->path == NULL) {
         return NGX_CONF_ERROR;
@@ -827,7 +827,7 @@ ngx_http_create_request(ngx_connection_t *c)
     }
 
 #if (NGX_HTTP_SSL)
-    if (c->ssl) {
+    if (c->ssl && !c->ssl->sendfile) {
         r->main_filter_need_in_memory = 1;
     }
 #endif
@@ -2867,6 +2867,30 @@ ngx_http_finalize_request(ngx_http_request_t *r, ngx_int_t rc)
 		 * 			      				 			| data |
 		 * 			      				 			--------
 		 */
+        if (r->background) {
+
+            if (!r->logged) {
+
+                clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+                if (clcf->log_subrequest) {
+                    ngx_http_log_request(r);
+                }
+
+                r->logged = 1;
+
+            } else {
+                ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                              "subrequest: \"%V?%V\" logged again",
+                              &r->uri, &r->args);
+            }
+
+            r->done = 1;
+
+            ngx_http_finalize_connection(r);
+            return;
+        }
+
         pr = r->parent;
 
         if (r == c->data) {
@@ -3174,6 +3198,10 @@ ngx_http_finalize_connection(ngx_http_request_t *r)
         return;
     }
 
+    /* the last one to finish may be a background subrequest */
+
+    r = r->main;
+
     if (r->reading_body) {
         r->keepalive = 0;
         r->lingering_close = 1;
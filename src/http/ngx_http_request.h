@@ -71,6 +71,16 @@
  */
 #define NGX_HTTP_SUBREQUEST_WAITED         4
 #define NGX_HTTP_LOG_UNSAFE                8
+/*
+ * The subrequest starts at the parent's location and content handler,
+ * with the parent's method.
+ */
+#define NGX_HTTP_SUBREQUEST_CLONE          16
+/*
+ * The subrequest does not take part in the output and is finalized
+ * on its own, the parent may complete before it.
+ */
+#define NGX_HTTP_SUBREQUEST_BACKGROUND     32
 
 
 #define NGX_HTTP_CONTINUE                  100
@@ -188,8 +198,25 @@ typedef struct {
 } ngx_http_header_out_t;
 
 
+typedef struct {
+    ngx_uint_t                        key;
+    ngx_table_elt_t                  *header;
+} ngx_http_header_index_elt_t;
+
+
+typedef struct {
+    ngx_http_header_index_elt_t      *elts;
+    ngx_uint_t                        mask;
+
+    /* the list state the index was built from */
+    ngx_list_part_t                  *last;
+    ngx_uint_t                        nelts;
+} ngx_http_header_index_t;
+
+
 typedef struct {
     ngx_list_t                        headers;
+    ngx_http_header_index_t          *index;
 
     ngx_table_elt_t                  *host;
     ngx_table_elt_t                  *connection;
@@ -310,6 +337,7 @@ typedef struct {
      * 响应体大小
      */
     off_t                             content_length_n;
+    off_t                             content_offset;
     time_t                            date_time;
     time_t                            last_modified_time;
 } ngx_http_headers_out_t;
@@ -795,6 +823,7 @@ struct ngx_http_request_s {
     // 子请求产生的数据需要在内存中
     unsigned                          subrequest_in_memory:1;
     unsigned                          waited:1;
+    unsigned                          background:1;
 
 #if (NGX_HTTP_CACHE)
     unsigned                          cached:1;
@@ -894,6 +923,7 @@ struct ngx_http_request_s {
 	 */
     unsigned                          filter_need_temporary:1;
     unsigned                          allow_ranges:1;
+    unsigned                          subrequest_ranges:1;
     unsigned                          single_range:1;
     unsigned                          disable_not_modified:1;
 
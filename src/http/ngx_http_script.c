@@ -12,6 +12,10 @@
 
 
 static ngx_int_t ngx_http_script_init_arrays(ngx_http_script_compile_t *sc);
+static ngx_int_t ngx_http_compile_complex_value_parts(ngx_conf_t *cf,
+    ngx_http_complex_value_t *cv);
+static ngx_int_t ngx_http_complex_value_parts(ngx_http_request_t *r,
+    ngx_http_complex_value_t *val, ngx_str_t *value);
 static ngx_int_t ngx_http_script_done(ngx_http_script_compile_t *sc);
 static ngx_int_t ngx_http_script_add_copy_code(ngx_http_script_compile_t *sc,
     ngx_str_t *value, ngx_uint_t last);
@@ -97,6 +101,10 @@ ngx_http_complex_value(ngx_http_request_t *r, ngx_http_complex_value_t *val,
 
     ngx_http_script_flush_complex_value(r, val);
 
+    if (val->parts) {
+        return ngx_http_complex_value_parts(r, val, value);
+    }
+
     ngx_memzero(&e, sizeof(ngx_http_script_engine_t));
 
     e.ip = val->lengths;
@@ -240,6 +248,9 @@ ngx_http_compile_complex_value(ngx_http_compile_complex_value_t *ccv)
     ccv->complex_value->flushes = NULL;
     ccv->complex_value->lengths = NULL;
     ccv->complex_value->values = NULL;
+    ccv->complex_value->parts = NULL;
+    ccv->complex_value->nparts = 0;
+    ccv->complex_value->size = 0;
 
     if (nv == 0 && nc == 0) {
     	/*
@@ -337,6 +348,142 @@ ngx_http_compile_complex_value(ngx_http_compile_complex_value_t *ccv)
     ccv->complex_value->lengths = lengths.elts;
     ccv->complex_value->values = values.elts;
 
+    return ngx_http_compile_complex_value_parts(ccv->cf, ccv->complex_value);
+}
+
+
+/*
+ * The values made of text and variables only are evaluated without
+ * the script engine: the parts are walked twice, to sum the variables
+ * lengths with the folded text length and then to copy the data.
+ * The values with captures, arguments or prefixes keep the codes.
+ */
+
+static ngx_int_t
+ngx_http_compile_complex_value_parts(ngx_conf_t *cf,
+    ngx_http_complex_value_t *cv)
+{
+    u_char                       *ip;
+    ngx_uint_t                    n;
+    ngx_http_script_part_t       *part;
+    ngx_http_script_code_pt       code;
+    ngx_http_script_var_code_t   *vcode;
+    ngx_http_script_copy_code_t  *ccode;
+
+    n = 0;
+
+    for (ip = cv->values; *(uintptr_t *) ip; n++) {
+        code = *(ngx_http_script_code_pt *) ip;
+
+        if (code == ngx_http_script_copy_code) {
+            ccode = (ngx_http_script_copy_code_t *) ip;
+
+            ip += sizeof(ngx_http_script_copy_code_t)
+                  + ((ccode->len + sizeof(uintptr_t) - 1)
+                     & ~(sizeof(uintptr_t) - 1));
+            continue;
+        }
+
+        if (code == ngx_http_script_copy_var_code) {
+            ip += sizeof(ngx_http_script_var_code_t);
+            continue;
+        }
+
+        return NGX_OK;
+    }
+
+    part = ngx_palloc(cf->pool, n * sizeof(ngx_http_script_part_t));
+    if (part == NULL) {
+        return NGX_ERROR;
+    }
+
+    cv->parts = part;
+    cv->nparts = n;
+    cv->size = 0;
+
+    for (ip = cv->values; *(uintptr_t *) ip; part++) {
+        code = *(ngx_http_script_code_pt *) ip;
+
+        if (code == ngx_http_script_copy_code) {
+            ccode = (ngx_http_script_copy_code_t *) ip;
+
+            part->data = ip + sizeof(ngx_http_script_copy_code_t);
+            part->len = ccode->len;
+            part->index = 0;
+
+            cv->size += ccode->len;
+
+            ip += sizeof(ngx_http_script_copy_code_t)
+                  + ((ccode->len + sizeof(uintptr_t) - 1)
+                     & ~(sizeof(uintptr_t) - 1));
+            continue;
+        }
+
+        vcode = (ngx_http_script_var_code_t *) ip;
+
+        part->data = NULL;
+        part->len = 0;
+        part->index = vcode->index;
+
+        ip += sizeof(ngx_http_script_var_code_t);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_complex_value_parts(ngx_http_request_t *r,
+    ngx_http_complex_value_t *val, ngx_str_t *value)
+{
+    u_char                     *p;
+    size_t                      len;
+    ngx_uint_t                  i;
+    ngx_http_script_part_t     *part;
+    ngx_http_variable_value_t  *vv;
+
+    part = val->parts;
+    len = val->size;
+
+    for (i = 0; i < val->nparts; i++) {
+        if (part[i].data) {
+            continue;
+        }
+
+        vv = ngx_http_get_indexed_variable(r, part[i].index);
+
+        if (vv && !vv->not_found) {
+            len += vv->len;
+        }
+    }
+
+    value->data = ngx_pnalloc(r->pool, len);
+    if (value->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = value->data;
+
+    for (i = 0; i < val->nparts; i++) {
+        if (part[i].data) {
+            p = ngx_cpymem(p, part[i].data, part[i].len);
+            continue;
+        }
+
+        /* the value is cached by the first walk */
+
+        vv = ngx_http_get_indexed_variable(r, part[i].index);
+
+        if (vv && !vv->not_found) {
+            p = ngx_cpymem(p, vv->data, vv->len);
+        }
+    }
+
+    value->len = p - value->data;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http complex value: \"%V\"", value);
+
     return NGX_OK;
 }
 
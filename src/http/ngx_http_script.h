@@ -376,6 +376,15 @@ typedef struct {
 } ngx_http_script_compile_t;
 
 
+/* a text part has data set, a variable part has the variable index */
+
+typedef struct {
+    u_char                     *data;
+    size_t                      len;
+    ngx_uint_t                  index;
+} ngx_http_script_part_t;
+
+
 /*
  * 复杂值编译后的结构体
  * 该结构体用来在运行时计算表达式的值
@@ -480,6 +489,14 @@ typedef struct {
      * 字段values里面的脚本是用来计算真正复杂值的
      */
     void                       *values;
+
+    /*
+     * values made of text and variables only are also compiled into
+     * the parts array, the text length is folded into size
+     */
+    ngx_http_script_part_t     *parts;
+    ngx_uint_t                  nparts;
+    size_t                      size;
 } ngx_http_complex_value_t;
 
 
@@ -287,6 +287,8 @@ static ngx_int_t ngx_http_upstream_cache_get(ngx_http_request_t *r,
     ngx_http_upstream_t *u, ngx_http_file_cache_t **cache);
 static ngx_int_t ngx_http_upstream_cache_send(ngx_http_request_t *r,
     ngx_http_upstream_t *u);
+static ngx_int_t ngx_http_upstream_cache_background_update(
+    ngx_http_request_t *r, ngx_http_upstream_t *u);
 static ngx_int_t ngx_http_upstream_cache_status(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_upstream_cache_last_modified(ngx_http_request_t *r,
@@ -459,6 +461,11 @@ ngx_http_upstream_header_t  ngx_http_upstream_headers_in[] = {
                  ngx_http_upstream_process_content_length, 0,
                  ngx_http_upstream_ignore_header_line, 0, 0 },
 
+    { ngx_string("Content-Range"),
+                 ngx_http_upstream_ignore_header_line, 0,
+                 ngx_http_upstream_copy_header_line,
+                 offsetof(ngx_http_headers_out_t, content_range), 0 },
+
     { ngx_string("Date"),
                  ngx_http_upstream_process_header_line,
                  offsetof(ngx_http_upstream_headers_in_t, date),
@@ -1125,9 +1132,29 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
     switch (rc) {
 
+    case NGX_HTTP_CACHE_STALE:
+
+        /*
+         * the request holds the update lock: serve the stale response
+         * and let a background subrequest update the cache
+         */
+
+        if ((u->conf->cache_use_stale & NGX_HTTP_UPSTREAM_FT_UPDATING)
+            && u->conf->cache_background_update
+            && !r->background)
+        {
+            c->background = 1;
+            u->cache_status = rc;
+            rc = NGX_OK;
+        }
+
+        break;
+
     case NGX_HTTP_CACHE_UPDATING:
 
-        if (u->conf->cache_use_stale & NGX_HTTP_UPSTREAM_FT_UPDATING) {
+        if ((u->conf->cache_use_stale & NGX_HTTP_UPSTREAM_FT_UPDATING)
+            && !r->background)
+        {
             u->cache_status = rc;
             rc = NGX_OK;
 
@@ -1147,11 +1174,18 @@ ngx_http_upstream_cache(ngx_http_request_t *r, ngx_http_upstream_t *u)
 
         rc = ngx_http_upstream_cache_send(r, u);
 
-        if (rc != NGX_HTTP_UPSTREAM_INVALID_HEADER) {
-            return rc;
+        if (rc == NGX_HTTP_UPSTREAM_INVALID_HEADER) {
+            c->background = 0;
+            break;
         }
 
-        break;
+        if (c->background && rc != NGX_ERROR && rc != NGX_DONE) {
+            if (ngx_http_upstream_cache_background_update(r, u) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+
+        return rc;
 
     case NGX_HTTP_CACHE_STALE:
 
@@ -1297,6 +1331,29 @@ ngx_http_upstream_cache_send(ngx_http_request_t *r, ngx_http_upstream_t *u)
     return rc;
 }
 
+
+static ngx_int_t
+ngx_http_upstream_cache_background_update(ngx_http_request_t *r,
+    ngx_http_upstream_t *u)
+{
+    ngx_http_request_t  *sr;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http upstream cache background update");
+
+    if (ngx_http_subrequest(r, &r->uri, &r->args, &sr, NULL,
+                            NGX_HTTP_SUBREQUEST_CLONE
+                            |NGX_HTTP_SUBREQUEST_BACKGROUND)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    sr->header_only = 1;
+
+    return NGX_OK;
+}
+
 #endif
 
 
@@ -154,6 +154,11 @@ static ngx_int_t ngx_http_variable_headers_internal(ngx_http_request_t *r,
 
 static ngx_int_t ngx_http_variable_unknown_header_in(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_http_header_index_t *ngx_http_variable_headers_index(
+    ngx_http_request_t *r);
+static ngx_uint_t ngx_http_variable_header_key(ngx_str_t *name);
+static ngx_int_t ngx_http_variable_header_cmp(ngx_str_t *name, u_char *data,
+    size_t len);
 static ngx_int_t ngx_http_variable_unknown_header_out(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
 static ngx_int_t ngx_http_variable_request_line(ngx_http_request_t *r,
@@ -1078,9 +1083,221 @@ static ngx_int_t
 ngx_http_variable_unknown_header_in(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data)
 {
-    return ngx_http_variable_unknown_header(v, (ngx_str_t *) data,
-                                            &r->headers_in.headers.part,
-                                            sizeof("http_") - 1);
+    ngx_str_t *var = (ngx_str_t *) data;
+
+    u_char                       *name;
+    size_t                        len;
+    ngx_uint_t                    i, key;
+    ngx_table_elt_t              *h;
+    ngx_http_header_index_t      *index;
+    ngx_http_header_index_elt_t  *elt;
+
+    index = ngx_http_variable_headers_index(r);
+    if (index == NULL) {
+        return NGX_ERROR;
+    }
+
+    name = var->data + sizeof("http_") - 1;
+    len = var->len - (sizeof("http_") - 1);
+
+    key = ngx_hash_key(name, len);
+
+    for (i = key & index->mask; /* void */ ; i = (i + 1) & index->mask) {
+        elt = &index->elts[i];
+
+        if (elt->header == NULL) {
+            v->not_found = 1;
+            return NGX_OK;
+        }
+
+        if (elt->key != key
+            || ngx_http_variable_header_cmp(&elt->header->key, name, len)
+               != 0)
+        {
+            continue;
+        }
+
+        h = elt->header;
+
+        if (h->hash == 0) {
+
+            /* the header was removed after the index had been built */
+
+            return ngx_http_variable_unknown_header(v, var,
+                                                   &r->headers_in.headers.part,
+                                                   sizeof("http_") - 1);
+        }
+
+        v->len = h->value.len;
+        v->valid = 1;
+        v->no_cacheable = 0;
+        v->not_found = 0;
+        v->data = h->value.data;
+
+        return NGX_OK;
+    }
+}
+
+
+/*
+ * the request headers are indexed on the first lookup of an unknown
+ * header variable, the index is rebuilt if headers were added since
+ */
+
+static ngx_http_header_index_t *
+ngx_http_variable_headers_index(ngx_http_request_t *r)
+{
+    ngx_uint_t                    i, j, n, size, key;
+    ngx_list_t                   *list;
+    ngx_list_part_t              *part;
+    ngx_table_elt_t              *header;
+    ngx_http_header_index_t      *index;
+    ngx_http_header_index_elt_t  *elt;
+
+    list = &r->headers_in.headers;
+    index = r->headers_in.index;
+
+    if (index && index->last == list->last && index->nelts == list->last->nelts)
+    {
+        return index;
+    }
+
+    n = 0;
+
+    for (part = &list->part; part; part = part->next) {
+        n += part->nelts;
+    }
+
+    for (size = 8; size < 2 * n; size <<= 1) { /* void */ }
+
+    index = ngx_palloc(r->pool, sizeof(ngx_http_header_index_t));
+    if (index == NULL) {
+        return NULL;
+    }
+
+    index->elts = ngx_pcalloc(r->pool,
+                              size * sizeof(ngx_http_header_index_elt_t));
+    if (index->elts == NULL) {
+        return NULL;
+    }
+
+    index->mask = size - 1;
+    index->last = list->last;
+    index->nelts = list->last->nelts;
+
+    part = &list->part;
+    header = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            header = part->elts;
+            i = 0;
+        }
+
+        if (header[i].hash == 0) {
+            continue;
+        }
+
+        key = ngx_http_variable_header_key(&header[i].key);
+
+        /* the first header with a given name wins */
+
+        for (j = key & index->mask; /* void */ ; j = (j + 1) & index->mask) {
+            elt = &index->elts[j];
+
+            if (elt->header == NULL) {
+                elt->key = key;
+                elt->header = &header[i];
+                break;
+            }
+
+            if (elt->key == key
+                && ngx_http_variable_header_cmp(&elt->header->key,
+                                                header[i].key.data,
+                                                header[i].key.len)
+                   == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    r->headers_in.index = index;
+
+    return index;
+}
+
+
+/*
+ * header names are matched case-insensitively with dashes
+ * treated as underscores, as in ngx_http_variable_unknown_header()
+ */
+
+static ngx_uint_t
+ngx_http_variable_header_key(ngx_str_t *name)
+{
+    u_char      ch;
+    ngx_uint_t  i, key;
+
+    key = 0;
+
+    for (i = 0; i < name->len; i++) {
+        ch = name->data[i];
+
+        if (ch >= 'A' && ch <= 'Z') {
+            ch |= 0x20;
+
+        } else if (ch == '-') {
+            ch = '_';
+        }
+
+        key = ngx_hash(key, ch);
+    }
+
+    return key;
+}
+
+
+static ngx_int_t
+ngx_http_variable_header_cmp(ngx_str_t *name, u_char *data, size_t len)
+{
+    u_char      c1, c2;
+    ngx_uint_t  i;
+
+    if (name->len != len) {
+        return 1;
+    }
+
+    for (i = 0; i < len; i++) {
+        c1 = name->data[i];
+        c2 = data[i];
+
+        if (c1 >= 'A' && c1 <= 'Z') {
+            c1 |= 0x20;
+
+        } else if (c1 == '-') {
+            c1 = '_';
+        }
+
+        if (c2 >= 'A' && c2 <= 'Z') {
+            c2 |= 0x20;
+
+        } else if (c2 == '-') {
+            c2 = '_';
+        }
+
+        if (c1 != c2) {
+            return 1;
+        }
+    }
+
+    return 0;
 }
 
 
@@ -2516,17 +2733,42 @@ ngx_http_map_find(ngx_http_request_t *r, ngx_http_map_t *map, ngx_str_t *match)
         return value;
     }
 
+    value = ngx_trie_find(&map->prefix, low, len);
+    if (value) {
+        return value;
+    }
+
 #if (NGX_PCRE)
 
     if (len && map->nregex) {
         ngx_int_t              n;
         ngx_uint_t             i;
         ngx_http_map_regex_t  *reg;
+#if (NGX_REGEX_SET)
+        ngx_int_t              first;
+
+        if (map->regex_set) {
+            first = ngx_regex_set_exec(map->regex_set, match);
+
+            if (first == NGX_DECLINED) {
+                return NULL;
+            }
+
+        } else {
+            first = 0;
+        }
+#endif
 
         reg = map->regex;
 
         for (i = 0; i < map->nregex; i++) {
 
+#if (NGX_REGEX_SET)
+            if (ngx_regex_set_skip(map->regex_set, i, first)) {
+                continue;
+            }
+#endif
+
             n = ngx_http_regex_exec(r, reg[i].regex, match);
 
             if (n == NGX_OK) {
@@ -155,9 +155,13 @@ ngx_int_t ngx_http_regex_exec(ngx_http_request_t *r, ngx_http_regex_t *re,
 
 typedef struct {
     ngx_hash_combined_t           hash;
+    ngx_trie_t                    prefix;
 #if (NGX_PCRE)
     ngx_http_map_regex_t         *regex;
     ngx_uint_t                    nregex;
+#if (NGX_REGEX_SET)
+    ngx_regex_set_t              *regex_set;
+#endif
 #endif
 } ngx_http_map_t;
 
@@ -97,6 +97,16 @@ typedef struct iocb  ngx_aiocb_t;
 #endif
 
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+#include <linux/filter.h>
+#endif
+
+
+#if (NGX_HAVE_NUMA)
+#include <linux/mempolicy.h>
+#endif
+
+
 #define NGX_LISTEN_BACKLOG        511
 
 
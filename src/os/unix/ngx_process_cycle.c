@@ -58,6 +58,8 @@ sig_atomic_t  ngx_noaccept;
 ngx_uint_t    ngx_noaccepting;
 ngx_uint_t    ngx_restart;
 
+ngx_wakeup_handler_pt  ngx_wakeup_handler;
+
 
 static u_char  master_process[] = "master process";
 
@@ -957,6 +959,13 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker)
 
         if (cpu_affinity) {
             ngx_setaffinity(cpu_affinity, cycle->log);
+
+#if (NGX_HAVE_NUMA)
+            if (ccf->numa) {
+                ngx_numa_set_preferred(ccf->numa_nodes, ccf->numa_nnodes,
+                                       cpu_affinity, cycle->log);
+            }
+#endif
         }
     }
 
@@ -1110,6 +1119,40 @@ ngx_worker_process_exit(ngx_cycle_t *cycle)
 }
 
 
+void
+ngx_wakeup_worker_processes(ngx_cycle_t *cycle)
+{
+    ngx_int_t      i;
+    ngx_channel_t  ch;
+
+    if (ngx_process != NGX_PROCESS_WORKER) {
+        return;
+    }
+
+    ngx_memzero(&ch, sizeof(ngx_channel_t));
+
+    ch.command = NGX_CMD_WAKEUP;
+    ch.pid = ngx_pid;
+    ch.slot = ngx_process_slot;
+    ch.fd = -1;
+
+    for (i = 0; i < ngx_last_process; i++) {
+
+        if (i == ngx_process_slot
+            || ngx_processes[i].pid == -1
+            || ngx_processes[i].channel[0] == -1)
+        {
+            continue;
+        }
+
+        /* a lost wakeup is only a delay, waiters also poll */
+
+        (void) ngx_write_channel(ngx_processes[i].channel[0],
+                                 &ch, sizeof(ngx_channel_t), cycle->log);
+    }
+}
+
+
 static void
 ngx_channel_handler(ngx_event_t *ev)
 {
@@ -1169,6 +1212,12 @@ ngx_channel_handler(ngx_event_t *ev)
             ngx_reopen = 1;
             break;
 
+        case NGX_CMD_WAKEUP:
+            if (ngx_wakeup_handler) {
+                ngx_wakeup_handler((ngx_cycle_t *) ngx_cycle);
+            }
+            break;
+
         case NGX_CMD_OPEN_CHANNEL:
 
             ngx_log_debug3(NGX_LOG_DEBUG_CORE, ev->log, 0,
@@ -1191,6 +1240,13 @@ ngx_channel_handler(ngx_event_t *ev)
 			 * 主进程用来和slot位置的子进程通信的文件描述符(和主进程的fd值不一定相同,但都代表同一个文件)
              */
             ngx_processes[ch.slot].channel[0] = ch.fd;
+
+            /* let ngx_wakeup_worker_processes() see later slots too */
+
+            if (ch.slot >= ngx_last_process) {
+                ngx_last_process = ch.slot + 1;
+            }
+
             break;
 
         case NGX_CMD_CLOSE_CHANNEL:
@@ -18,6 +18,7 @@
 #define NGX_CMD_QUIT           3
 #define NGX_CMD_TERMINATE      4
 #define NGX_CMD_REOPEN         5
+#define NGX_CMD_WAKEUP         6
 
 
 // 非master-worker类型
@@ -39,8 +40,12 @@ typedef struct {
 } ngx_cache_manager_ctx_t;
 
 
+typedef void (*ngx_wakeup_handler_pt)(ngx_cycle_t *cycle);
+
+
 void ngx_master_process_cycle(ngx_cycle_t *cycle);
 void ngx_single_process_cycle(ngx_cycle_t *cycle);
+void ngx_wakeup_worker_processes(ngx_cycle_t *cycle);
 
 
 extern ngx_uint_t      ngx_process;
@@ -51,6 +56,8 @@ extern ngx_uint_t      ngx_inherited;
 extern ngx_uint_t      ngx_daemonized;
 extern ngx_uint_t      ngx_exiting;
 
+extern ngx_wakeup_handler_pt  ngx_wakeup_handler;
+
 extern sig_atomic_t    ngx_reap;
 extern sig_atomic_t    ngx_sigio;
 extern sig_atomic_t    ngx_sigalrm;
@@ -67,3 +67,172 @@ ngx_setaffinity(uint64_t cpu_affinity, ngx_log_t *log)
 }
 
 #endif
+
+
+#if (NGX_HAVE_NUMA)
+
+static uint64_t ngx_numa_parse_cpulist(u_char *p, u_char *last);
+
+
+/* nodes must have room for NGX_NUMA_MAX_NODES entries */
+
+ngx_uint_t
+ngx_numa_get_nodes(ngx_numa_node_t *nodes, ngx_log_t *log)
+{
+    u_char      *last, path[NGX_MAX_PATH], buf[256];
+    ssize_t      n;
+    ngx_fd_t     fd;
+    ngx_uint_t   id, nnodes;
+
+    nnodes = 0;
+
+    for (id = 0; id < NGX_NUMA_MAX_NODES; id++) {
+
+        last = ngx_snprintf(path, NGX_MAX_PATH - 1,
+                            "/sys/devices/system/node/node%ui/cpulist", id);
+        *last = '\0';
+
+        fd = ngx_open_file(path, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+        if (fd == NGX_INVALID_FILE) {
+            continue;
+        }
+
+        n = ngx_read_fd(fd, buf, sizeof(buf));
+
+        if (n == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          ngx_read_fd_n " \"%s\" failed", path);
+        }
+
+        if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          ngx_close_file_n " \"%s\" failed", path);
+        }
+
+        if (n <= 0) {
+            continue;
+        }
+
+        nodes[nnodes].id = id;
+        nodes[nnodes].cpus = ngx_numa_parse_cpulist(buf, buf + n);
+
+        ngx_log_debug2(NGX_LOG_DEBUG_CORE, log, 0,
+                       "numa node %ui cpus: 0x%08Xl", id, nodes[nnodes].cpus);
+
+        nnodes++;
+    }
+
+    return nnodes;
+}
+
+
+/* "0-3,8-11\n", only the first 64 CPUs are taken into account */
+
+static uint64_t
+ngx_numa_parse_cpulist(u_char *p, u_char *last)
+{
+    uint64_t    cpus;
+    ngx_uint_t  from, to;
+
+    cpus = 0;
+
+    while (p < last) {
+
+        if (*p < '0' || *p > '9') {
+            p++;
+            continue;
+        }
+
+        from = 0;
+
+        while (p < last && *p >= '0' && *p <= '9') {
+            from = from * 10 + (*p++ - '0');
+        }
+
+        to = from;
+
+        if (p < last && *p == '-') {
+            p++;
+            to = 0;
+
+            while (p < last && *p >= '0' && *p <= '9') {
+                to = to * 10 + (*p++ - '0');
+            }
+        }
+
+        while (from <= to && from < 64) {
+            cpus |= (uint64_t) 1 << from++;
+        }
+    }
+
+    return cpus;
+}
+
+
+void
+ngx_numa_set_preferred(ngx_numa_node_t *nodes, ngx_uint_t n,
+    uint64_t cpu_affinity, ngx_log_t *log)
+{
+    ngx_uint_t     i;
+    unsigned long  mask;
+
+    /* the first node the worker may run on */
+
+    for (i = 0; i < n; i++) {
+        if (nodes[i].cpus & cpu_affinity) {
+            break;
+        }
+    }
+
+    if (i == n) {
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_NOTICE, log, 0,
+                  "set_mempolicy(MPOL_PREFERRED, node %ui)", nodes[i].id);
+
+    mask = 1UL << nodes[i].id;
+
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask,
+                NGX_NUMA_MAX_NODES + 1)
+        == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      "set_mempolicy() failed");
+    }
+}
+
+
+void
+ngx_numa_mbind(void *addr, size_t size, ngx_int_t policy,
+    ngx_numa_node_t *nodes, ngx_uint_t n, ngx_log_t *log)
+{
+    int            mode;
+    ngx_uint_t     i;
+    unsigned long  mask;
+
+    if (policy == NGX_NUMA_SHM_INTERLEAVE) {
+        mode = MPOL_INTERLEAVE;
+        mask = 0;
+
+        for (i = 0; i < n; i++) {
+            mask |= 1UL << nodes[i].id;
+        }
+
+    } else {
+        mode = MPOL_PREFERRED;
+        mask = 1UL << policy;
+    }
+
+    /* the pages are not touched yet, so they are placed when first used */
+
+    if (syscall(SYS_mbind, addr, size, mode, &mask, NGX_NUMA_MAX_NODES + 1, 0)
+        == -1)
+    {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      "mbind(%p, %uz, 0x%lx) failed", addr, size, mask);
+    }
+}
+
+#endif
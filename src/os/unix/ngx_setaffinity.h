@@ -20,4 +20,25 @@ void ngx_setaffinity(uint64_t cpu_affinity, ngx_log_t *log);
 #endif
 
 
+#define NGX_NUMA_SHM_DEFAULT     -1
+#define NGX_NUMA_SHM_INTERLEAVE  -2
+
+#if (NGX_HAVE_NUMA)
+
+#define NGX_NUMA_MAX_NODES       (sizeof(unsigned long) * 8)
+
+typedef struct {
+    ngx_uint_t   id;
+    uint64_t     cpus;
+} ngx_numa_node_t;
+
+ngx_uint_t ngx_numa_get_nodes(ngx_numa_node_t *nodes, ngx_log_t *log);
+void ngx_numa_set_preferred(ngx_numa_node_t *nodes, ngx_uint_t n,
+    uint64_t cpu_affinity, ngx_log_t *log);
+void ngx_numa_mbind(void *addr, size_t size, ngx_int_t policy,
+    ngx_numa_node_t *nodes, ngx_uint_t n, ngx_log_t *log);
+
+#endif
+
+
 #endif /* _NGX_SETAFFINITY_H_INCLUDED_ */
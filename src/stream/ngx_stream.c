@@ -282,7 +282,10 @@ ngx_stream_add_ports(ngx_conf_t *cf, ngx_array_t *ports,
 
     port = ports->elts;
     for (i = 0; i < ports->nelts; i++) {
-        if (p == port[i].port && sa->sa_family == port[i].family) {
+        if (p == port[i].port
+            && listen->type == port[i].type
+            && sa->sa_family == port[i].family)
+        {
 
             /* a port is already in the port list */
 
@@ -299,6 +302,7 @@ ngx_stream_add_ports(ngx_conf_t *cf, ngx_array_t *ports,
     }
 
     port->family = sa->sa_family;
+    port->type = listen->type;
     port->port = p;
 
     if (ngx_array_init(&port->addrs, cf->temp_pool, 2,
@@ -369,6 +373,7 @@ ngx_stream_optimize_servers(ngx_conf_t *cf, ngx_array_t *ports)
             }
 
             ls->addr_ntop = 1;
+            ls->type = addr[i].opt.type;
             ls->handler = ngx_stream_init_connection;
             ls->pool_size = 256;
 
@@ -24,6 +24,14 @@ typedef struct ngx_stream_session_s  ngx_stream_session_t;
 #include <ngx_stream_upstream_round_robin.h>
 
 
+#define NGX_STREAM_OK                        200
+#define NGX_STREAM_BAD_REQUEST               400
+#define NGX_STREAM_FORBIDDEN                 403
+#define NGX_STREAM_INTERNAL_SERVER_ERROR     500
+#define NGX_STREAM_BAD_GATEWAY               502
+#define NGX_STREAM_SERVICE_UNAVAILABLE       503
+
+
 typedef struct {
     void                  **main_conf;
     void                  **srv_conf;
@@ -66,6 +74,7 @@ typedef struct {
     int                     tcp_keepcnt;
 #endif
     int                     backlog;
+    int                     type;
 } ngx_stream_listen_t;
 
 
@@ -102,6 +111,7 @@ typedef struct {
 
 typedef struct {
     int                     family;
+    int                     type;
     in_port_t               port;
     ngx_array_t             addrs;       /* array of ngx_stream_conf_addr_t */
 } ngx_stream_conf_port_t;
@@ -120,6 +130,7 @@ typedef struct {
     ngx_array_t             listen;      /* ngx_stream_listen_t */
     ngx_stream_access_pt    limit_conn_handler;
     ngx_stream_access_pt    access_handler;
+    ngx_stream_access_pt    log_handler;
 } ngx_stream_core_main_conf_t;
 
 
@@ -142,6 +153,10 @@ struct ngx_stream_session_s {
     ngx_connection_t       *connection;
 
     off_t                   received;
+    time_t                  start_sec;
+    ngx_msec_t              start_msec;
+
+    ngx_uint_t              status;
 
     ngx_log_handler_pt      log_handler;
 
@@ -199,6 +214,7 @@ typedef struct {
 
 
 void ngx_stream_init_connection(ngx_connection_t *c);
+void ngx_stream_finalize_session(ngx_stream_session_t *s, ngx_uint_t rc);
 void ngx_stream_close_connection(ngx_connection_t *c);
 
 
@@ -131,6 +131,9 @@ ngx_stream_init_connection(ngx_connection_t *c)
     s->connection = c;
     c->data = s;
 
+    s->start_sec = ngx_time();
+    s->start_msec = ngx_current_msec;
+
     cscf = ngx_stream_get_module_srv_conf(s, ngx_stream_core_module);
 
     ngx_set_connection_log(c, cscf->error_log);
@@ -152,7 +155,7 @@ ngx_stream_init_connection(ngx_connection_t *c)
         rc = cmcf->limit_conn_handler(s);
 
         if (rc != NGX_DECLINED) {
-            ngx_stream_close_connection(c);
+            ngx_stream_finalize_session(s, NGX_STREAM_SERVICE_UNAVAILABLE);
             return;
         }
     }
@@ -161,12 +164,15 @@ ngx_stream_init_connection(ngx_connection_t *c)
         rc = cmcf->access_handler(s);
 
         if (rc != NGX_OK && rc != NGX_DECLINED) {
-            ngx_stream_close_connection(c);
+            ngx_stream_finalize_session(s, NGX_STREAM_FORBIDDEN);
             return;
         }
     }
 
-    if (cscf->tcp_nodelay && c->tcp_nodelay == NGX_TCP_NODELAY_UNSET) {
+    if (c->type == SOCK_STREAM
+        && cscf->tcp_nodelay
+        && c->tcp_nodelay == NGX_TCP_NODELAY_UNSET)
+    {
         ngx_log_debug0(NGX_LOG_DEBUG_STREAM, c->log, 0, "tcp_nodelay");
 
         tcp_nodelay = 1;
@@ -176,7 +182,7 @@ ngx_stream_init_connection(ngx_connection_t *c)
         {
             ngx_connection_error(c, ngx_socket_errno,
                                  "setsockopt(TCP_NODELAY) failed");
-            ngx_stream_close_connection(c);
+            ngx_stream_finalize_session(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return;
         }
 
@@ -197,7 +203,7 @@ ngx_stream_init_connection(ngx_connection_t *c)
             ngx_log_error(NGX_LOG_ERR, c->log, 0,
                           "no \"ssl_certificate\" is defined "
                           "in server listening on SSL port");
-            ngx_stream_close_connection(c);
+            ngx_stream_finalize_session(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return;
         }
 
@@ -224,7 +230,7 @@ ngx_stream_init_session(ngx_connection_t *c)
 
     s->ctx = ngx_pcalloc(c->pool, sizeof(void *) * ngx_stream_max_module);
     if (s->ctx == NULL) {
-        ngx_stream_close_connection(c);
+        ngx_stream_finalize_session(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
@@ -240,15 +246,15 @@ ngx_stream_ssl_init_connection(ngx_ssl_t *ssl, ngx_connection_t *c)
     ngx_stream_session_t   *s;
     ngx_stream_ssl_conf_t  *sslcf;
 
+    s = c->data;
+
     if (ngx_ssl_create_connection(ssl, c, 0) == NGX_ERROR) {
-        ngx_stream_close_connection(c);
+        ngx_stream_finalize_session(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
     if (ngx_ssl_handshake(c) == NGX_AGAIN) {
 
-        s = c->data;
-
         sslcf = ngx_stream_get_module_srv_conf(s, ngx_stream_ssl_module);
 
         ngx_add_timer(c->read, sslcf->handshake_timeout);
@@ -266,7 +272,7 @@ static void
 ngx_stream_ssl_handshake_handler(ngx_connection_t *c)
 {
     if (!c->ssl->handshaked) {
-        ngx_stream_close_connection(c);
+        ngx_stream_finalize_session(c->data, NGX_STREAM_BAD_REQUEST);
         return;
     }
 
@@ -280,6 +286,31 @@ ngx_stream_ssl_handshake_handler(ngx_connection_t *c)
 #endif
 
 
+void
+ngx_stream_finalize_session(ngx_stream_session_t *s, ngx_uint_t rc)
+{
+    ngx_connection_t             *c;
+    ngx_stream_core_main_conf_t  *cmcf;
+
+    c = s->connection;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                   "finalize stream session: %ui", rc);
+
+    s->status = rc;
+
+    cmcf = ngx_stream_get_module_main_conf(s, ngx_stream_core_module);
+
+    if (cmcf->log_handler) {
+        c->log->action = "logging session";
+
+        (void) cmcf->log_handler(s);
+    }
+
+    ngx_stream_close_connection(c);
+}
+
+
 void
 ngx_stream_close_connection(ngx_connection_t *c)
 {
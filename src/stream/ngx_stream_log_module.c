@@ -0,0 +1,1830 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_stream.h>
+
+#if (NGX_ZLIB)
+#include <zlib.h>
+#endif
+
+
+typedef struct ngx_stream_log_op_s  ngx_stream_log_op_t;
+
+typedef u_char *(*ngx_stream_log_op_run_pt) (ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+
+typedef size_t (*ngx_stream_log_op_getlen_pt) (ngx_stream_session_t *s,
+    uintptr_t data);
+
+
+struct ngx_stream_log_op_s {
+    size_t                        len;
+    ngx_stream_log_op_getlen_pt   getlen;
+    ngx_stream_log_op_run_pt      run;
+    uintptr_t                     data;
+};
+
+
+typedef struct {
+    ngx_str_t                     name;
+    ngx_array_t                  *ops;        /* array of ngx_stream_log_op_t */
+} ngx_stream_log_fmt_t;
+
+
+typedef struct {
+    ngx_array_t                   formats;    /* of ngx_stream_log_fmt_t */
+} ngx_stream_log_main_conf_t;
+
+
+typedef struct {
+    u_char                       *start;
+    u_char                       *pos;
+    u_char                       *last;
+
+    ngx_event_t                  *event;
+    ngx_msec_t                    flush;
+    ngx_int_t                     gzip;
+} ngx_stream_log_buf_t;
+
+
+typedef struct {
+    ngx_open_file_t              *file;
+    time_t                        disk_full_time;
+    time_t                        error_log_time;
+    ngx_syslog_peer_t            *syslog_peer;
+    ngx_stream_log_fmt_t         *format;
+    ngx_uint_t                    sample;     /* of NGX_STREAM_LOG_SAMPLE_ALL */
+} ngx_stream_log_t;
+
+
+#define NGX_STREAM_LOG_SAMPLE_ALL  10000
+
+
+/*
+ * per-interval counters of sessions grouped by a key,
+ * collected by each worker process separately
+ */
+
+typedef struct {
+    ngx_open_file_t              *file;
+    ngx_array_t                  *key;        /* array of ngx_stream_log_op_t */
+    ngx_msec_t                    interval;
+    ngx_event_t                  *event;
+    ngx_log_aggregate_keys_t      keys;
+} ngx_stream_log_aggregate_t;
+
+
+typedef struct {
+    ngx_log_aggregate_node_t      key;
+
+    ngx_uint_t                    sessions;
+    ngx_uint_t                    status[5];  /* 1xx to 5xx */
+    off_t                         bytes_sent;
+    off_t                         bytes_received;
+    ngx_msec_t                    time;
+    ngx_msec_t                    time_max;
+    ngx_msec_t                    connect_time;
+    ngx_uint_t                    connects;
+} ngx_stream_log_aggregate_node_t;
+
+
+typedef struct {
+    ngx_array_t                  *logs;       /* array of ngx_stream_log_t */
+    ngx_array_t                  *aggregates; /* ngx_stream_log_aggregate_t * */
+
+    ngx_uint_t                    off;        /* unsigned  off:1 */
+} ngx_stream_log_srv_conf_t;
+
+
+typedef struct {
+    ngx_str_t                     name;
+    size_t                        len;
+    ngx_stream_log_op_getlen_pt   getlen;
+    ngx_stream_log_op_run_pt      run;
+} ngx_stream_log_var_t;
+
+
+static void ngx_stream_log_write(ngx_stream_session_t *s, ngx_stream_log_t *log,
+    u_char *buf, size_t len);
+
+#if (NGX_ZLIB)
+static ssize_t ngx_stream_log_gzip(ngx_fd_t fd, u_char *buf, size_t len,
+    ngx_int_t level, ngx_log_t *log);
+
+static void *ngx_stream_log_gzip_alloc(void *opaque, u_int items, u_int size);
+static void ngx_stream_log_gzip_free(void *opaque, void *address);
+#endif
+
+static void ngx_stream_log_flush(ngx_open_file_t *file, ngx_log_t *log);
+static void ngx_stream_log_flush_handler(ngx_event_t *ev);
+
+static ngx_int_t ngx_stream_log_aggregate(ngx_stream_session_t *s,
+    ngx_stream_log_aggregate_t *agg);
+static void ngx_stream_log_aggregate_flush_handler(ngx_event_t *ev);
+
+static u_char *ngx_stream_log_copy_short(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_copy_long(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static in_port_t ngx_stream_log_sockaddr_port(struct sockaddr *sa);
+static size_t ngx_stream_log_remote_addr_getlen(ngx_stream_session_t *s,
+    uintptr_t data);
+static u_char *ngx_stream_log_remote_addr(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_remote_port(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_server_addr(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_server_port(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_protocol(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_connection(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_pid(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_time(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_iso8601(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_msec(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_session_time(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_status(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_bytes_sent(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_bytes_received(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static size_t ngx_stream_log_upstream_addr_getlen(ngx_stream_session_t *s,
+    uintptr_t data);
+static u_char *ngx_stream_log_upstream_addr(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_upstream_connect_time(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_upstream_bytes_sent(ngx_stream_session_t *s,
+    u_char *buf, ngx_stream_log_op_t *op);
+static u_char *ngx_stream_log_upstream_bytes_received(
+    ngx_stream_session_t *s, u_char *buf, ngx_stream_log_op_t *op);
+
+static size_t ngx_stream_log_ops_len(ngx_stream_session_t *s,
+    ngx_array_t *ops);
+static u_char *ngx_stream_log_ops_run(ngx_stream_session_t *s, u_char *buf,
+    ngx_array_t *ops);
+
+static void *ngx_stream_log_create_main_conf(ngx_conf_t *cf);
+static void *ngx_stream_log_create_srv_conf(ngx_conf_t *cf);
+static char *ngx_stream_log_merge_srv_conf(ngx_conf_t *cf, void *parent,
+    void *child);
+static char *ngx_stream_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_stream_log_set_format(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_stream_log_compile_format(ngx_conf_t *cf, ngx_array_t *ops,
+    ngx_array_t *args, ngx_uint_t s);
+static char *ngx_stream_log_set_aggregate(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static ngx_int_t ngx_stream_log_init(ngx_conf_t *cf);
+
+
+static ngx_command_t  ngx_stream_log_commands[] = {
+
+    { ngx_string("log_format"),
+      NGX_STREAM_MAIN_CONF|NGX_CONF_2MORE,
+      ngx_stream_log_set_format,
+      NGX_STREAM_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("access_log"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_1MORE,
+      ngx_stream_log_set_log,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("log_aggregate"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_2MORE,
+      ngx_stream_log_set_aggregate,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_stream_module_t  ngx_stream_log_module_ctx = {
+    ngx_stream_log_init,                   /* postconfiguration */
+
+    ngx_stream_log_create_main_conf,       /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_stream_log_create_srv_conf,        /* create server configuration */
+    ngx_stream_log_merge_srv_conf          /* merge server configuration */
+};
+
+
+ngx_module_t  ngx_stream_log_module = {
+    NGX_MODULE_V1,
+    &ngx_stream_log_module_ctx,            /* module context */
+    ngx_stream_log_commands,               /* module directives */
+    NGX_STREAM_MODULE,                     /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_str_t  ngx_stream_basic_fmt =
+    ngx_string("$remote_addr [$time_local] $protocol $status $bytes_sent "
+               "$bytes_received $session_time \"$upstream_addr\" "
+               "$upstream_connect_time");
+
+
+static ngx_stream_log_var_t  ngx_stream_log_vars[] = {
+    { ngx_string("remote_addr"), 0, ngx_stream_log_remote_addr_getlen,
+                          ngx_stream_log_remote_addr },
+    { ngx_string("remote_port"), sizeof("65535") - 1, NULL,
+                          ngx_stream_log_remote_port },
+    { ngx_string("server_addr"), NGX_SOCKADDR_STRLEN, NULL,
+                          ngx_stream_log_server_addr },
+    { ngx_string("server_port"), sizeof("65535") - 1, NULL,
+                          ngx_stream_log_server_port },
+    { ngx_string("protocol"), sizeof("TCP") - 1, NULL,
+                          ngx_stream_log_protocol },
+    { ngx_string("connection"), NGX_ATOMIC_T_LEN, NULL,
+                          ngx_stream_log_connection },
+    { ngx_string("pid"), NGX_INT64_LEN, NULL, ngx_stream_log_pid },
+    { ngx_string("time_local"), sizeof("28/Sep/1970:12:00:00 +0600") - 1,
+                          NULL, ngx_stream_log_time },
+    { ngx_string("time_iso8601"), sizeof("1970-09-28T12:00:00+06:00") - 1,
+                          NULL, ngx_stream_log_iso8601 },
+    { ngx_string("msec"), NGX_TIME_T_LEN + 4, NULL, ngx_stream_log_msec },
+    { ngx_string("session_time"), NGX_TIME_T_LEN + 4, NULL,
+                          ngx_stream_log_session_time },
+    { ngx_string("status"), NGX_INT_T_LEN, NULL, ngx_stream_log_status },
+    { ngx_string("bytes_sent"), NGX_OFF_T_LEN, NULL,
+                          ngx_stream_log_bytes_sent },
+    { ngx_string("bytes_received"), NGX_OFF_T_LEN, NULL,
+                          ngx_stream_log_bytes_received },
+    { ngx_string("upstream_addr"), 0, ngx_stream_log_upstream_addr_getlen,
+                          ngx_stream_log_upstream_addr },
+    { ngx_string("upstream_connect_time"), NGX_TIME_T_LEN + 4, NULL,
+                          ngx_stream_log_upstream_connect_time },
+    { ngx_string("upstream_bytes_sent"), NGX_OFF_T_LEN, NULL,
+                          ngx_stream_log_upstream_bytes_sent },
+    { ngx_string("upstream_bytes_received"), NGX_OFF_T_LEN, NULL,
+                          ngx_stream_log_upstream_bytes_received },
+
+    { ngx_null_string, 0, NULL, NULL }
+};
+
+
+static ngx_int_t
+ngx_stream_log_handler(ngx_stream_session_t *s)
+{
+    u_char                      *line, *p;
+    size_t                       len, size;
+    ssize_t                      n;
+    ngx_uint_t                   l;
+    ngx_stream_log_t            *log;
+    ngx_stream_log_buf_t        *buffer;
+    ngx_stream_log_srv_conf_t   *lscf;
+    ngx_stream_log_aggregate_t **agg;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
+                   "stream log handler");
+
+    lscf = ngx_stream_get_module_srv_conf(s, ngx_stream_log_module);
+
+    if (lscf->aggregates) {
+        agg = lscf->aggregates->elts;
+
+        for (l = 0; l < lscf->aggregates->nelts; l++) {
+            if (ngx_stream_log_aggregate(s, agg[l]) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    if (lscf->off || lscf->logs == NULL) {
+        return NGX_OK;
+    }
+
+    log = lscf->logs->elts;
+    for (l = 0; l < lscf->logs->nelts; l++) {
+
+        if (log[l].sample < NGX_STREAM_LOG_SAMPLE_ALL
+            && (ngx_uint_t) ngx_random() % NGX_STREAM_LOG_SAMPLE_ALL
+               >= log[l].sample)
+        {
+            continue;
+        }
+
+        if (ngx_time() == log[l].disk_full_time) {
+
+            /*
+             * on FreeBSD writing to a full filesystem with enabled softupdates
+             * may block process for much longer time than writing to non-full
+             * filesystem, so we skip writing to a log for one second
+             */
+
+            continue;
+        }
+
+        len = ngx_stream_log_ops_len(s, log[l].format->ops);
+
+        if (log[l].syslog_peer) {
+
+            /* length of syslog's PRI and HEADER message parts */
+            len += sizeof("<255>Jan 01 00:00:00 ") - 1
+                   + ngx_cycle->hostname.len + 1
+                   + log[l].syslog_peer->tag.len + 2;
+
+            goto alloc_line;
+        }
+
+        len += NGX_LINEFEED_SIZE;
+
+        buffer = log[l].file->data;
+
+        if (buffer) {
+
+            if (len > (size_t) (buffer->last - buffer->pos)) {
+
+                ngx_stream_log_write(s, &log[l], buffer->start,
+                                     buffer->pos - buffer->start);
+
+                buffer->pos = buffer->start;
+            }
+
+            if (len <= (size_t) (buffer->last - buffer->pos)) {
+
+                p = buffer->pos;
+
+                if (buffer->event && p == buffer->start) {
+                    ngx_add_timer(buffer->event, buffer->flush);
+                }
+
+                p = ngx_stream_log_ops_run(s, p, log[l].format->ops);
+
+                ngx_linefeed(p);
+
+                buffer->pos = p;
+
+                continue;
+            }
+
+            if (buffer->event && buffer->event->timer_set) {
+                ngx_del_timer(buffer->event);
+            }
+        }
+
+    alloc_line:
+
+        line = ngx_pnalloc(s->connection->pool, len);
+        if (line == NULL) {
+            return NGX_ERROR;
+        }
+
+        p = line;
+
+        if (log[l].syslog_peer) {
+            p = ngx_syslog_add_header(log[l].syslog_peer, line);
+        }
+
+        p = ngx_stream_log_ops_run(s, p, log[l].format->ops);
+
+        if (log[l].syslog_peer) {
+
+            size = p - line;
+
+            n = ngx_syslog_send(log[l].syslog_peer, line, size);
+
+            if (n < 0) {
+                ngx_log_error(NGX_LOG_WARN, s->connection->log, 0,
+                              "send() to syslog failed");
+
+            } else if ((size_t) n != size) {
+                ngx_log_error(NGX_LOG_WARN, s->connection->log, 0,
+                              "send() to syslog has written only %z of %uz",
+                              n, size);
+            }
+
+            continue;
+        }
+
+        ngx_linefeed(p);
+
+        ngx_stream_log_write(s, &log[l], line, p - line);
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_stream_log_write(ngx_stream_session_t *s, ngx_stream_log_t *log,
+    u_char *buf, size_t len)
+{
+    time_t                 now;
+    ssize_t                n;
+    ngx_err_t              err;
+#if (NGX_ZLIB)
+    ngx_stream_log_buf_t  *buffer;
+
+    buffer = log->file->data;
+
+    if (buffer && buffer->gzip) {
+        n = ngx_stream_log_gzip(log->file->fd, buf, len, buffer->gzip,
+                                s->connection->log);
+    } else {
+        n = ngx_write_fd(log->file->fd, buf, len);
+    }
+#else
+    n = ngx_write_fd(log->file->fd, buf, len);
+#endif
+
+    if (n == (ssize_t) len) {
+        return;
+    }
+
+    now = ngx_time();
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        if (err == NGX_ENOSPC) {
+            log->disk_full_time = now;
+        }
+
+        if (now - log->error_log_time > 59) {
+            ngx_log_error(NGX_LOG_ALERT, s->connection->log, err,
+                          ngx_write_fd_n " to \"%s\" failed",
+                          log->file->name.data);
+
+            log->error_log_time = now;
+        }
+
+        return;
+    }
+
+    if (now - log->error_log_time > 59) {
+        ngx_log_error(NGX_LOG_ALERT, s->connection->log, 0,
+                      ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                      log->file->name.data, n, len);
+
+        log->error_log_time = now;
+    }
+}
+
+
+#if (NGX_ZLIB)
+
+static ssize_t
+ngx_stream_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
+    ngx_log_t *log)
+{
+    int          rc, wbits, memlevel;
+    u_char      *out;
+    size_t       size;
+    ssize_t      n;
+    z_stream     zstream;
+    ngx_err_t    err;
+    ngx_pool_t  *pool;
+
+    wbits = MAX_WBITS;
+    memlevel = MAX_MEM_LEVEL - 1;
+
+    while ((ssize_t) len < ((1 << (wbits - 1)) - 262)) {
+        wbits--;
+        memlevel--;
+    }
+
+    /*
+     * This is a formula from deflateBound() for conservative upper bound of
+     * compressed data plus 18 bytes of gzip wrapper.
+     */
+
+    size = len + ((len + 7) >> 3) + ((len + 63) >> 6) + 5 + 18;
+
+    ngx_memzero(&zstream, sizeof(z_stream));
+
+    pool = ngx_create_pool(256, log);
+    if (pool == NULL) {
+        /* simulate successful logging */
+        return len;
+    }
+
+    pool->log = log;
+
+    zstream.zalloc = ngx_stream_log_gzip_alloc;
+    zstream.zfree = ngx_stream_log_gzip_free;
+    zstream.opaque = pool;
+
+    out = ngx_pnalloc(pool, size);
+    if (out == NULL) {
+        goto done;
+    }
+
+    zstream.next_in = buf;
+    zstream.avail_in = len;
+    zstream.next_out = out;
+    zstream.avail_out = size;
+
+    rc = deflateInit2(&zstream, (int) level, Z_DEFLATED, wbits + 16, memlevel,
+                      Z_DEFAULT_STRATEGY);
+
+    if (rc != Z_OK) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0, "deflateInit2() failed: %d", rc);
+        goto done;
+    }
+
+    rc = deflate(&zstream, Z_FINISH);
+
+    if (rc != Z_STREAM_END) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0,
+                      "deflate(Z_FINISH) failed: %d", rc);
+        goto done;
+    }
+
+    size -= zstream.avail_out;
+
+    rc = deflateEnd(&zstream);
+
+    if (rc != Z_OK) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0, "deflateEnd() failed: %d", rc);
+        goto done;
+    }
+
+    n = ngx_write_fd(fd, out, size);
+
+    if (n != (ssize_t) size) {
+        err = (n == -1) ? ngx_errno : 0;
+
+        ngx_destroy_pool(pool);
+
+        ngx_set_errno(err);
+        return -1;
+    }
+
+done:
+
+    ngx_destroy_pool(pool);
+
+    /* simulate successful logging */
+    return len;
+}
+
+
+static void *
+ngx_stream_log_gzip_alloc(void *opaque, u_int items, u_int size)
+{
+    ngx_pool_t *pool = opaque;
+
+    return ngx_palloc(pool, items * size);
+}
+
+
+static void
+ngx_stream_log_gzip_free(void *opaque, void *address)
+{
+}
+
+#endif
+
+
+static void
+ngx_stream_log_flush(ngx_open_file_t *file, ngx_log_t *log)
+{
+    size_t                 len;
+    ssize_t                n;
+    ngx_stream_log_buf_t  *buffer;
+
+    buffer = file->data;
+
+    len = buffer->pos - buffer->start;
+
+    if (len == 0) {
+        return;
+    }
+
+#if (NGX_ZLIB)
+    if (buffer->gzip) {
+        n = ngx_stream_log_gzip(file->fd, buffer->start, len, buffer->gzip,
+                                log);
+    } else {
+        n = ngx_write_fd(file->fd, buffer->start, len);
+    }
+#else
+    n = ngx_write_fd(file->fd, buffer->start, len);
+#endif
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_write_fd_n " to \"%s\" failed",
+                      file->name.data);
+
+    } else if ((size_t) n != len) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0,
+                      ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                      file->name.data, n, len);
+    }
+
+    buffer->pos = buffer->start;
+
+    if (buffer->event && buffer->event->timer_set) {
+        ngx_del_timer(buffer->event);
+    }
+}
+
+
+static void
+ngx_stream_log_flush_handler(ngx_event_t *ev)
+{
+    ngx_open_file_t       *file;
+    ngx_stream_log_buf_t  *buffer;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "stream log buffer flush handler");
+
+    file = ev->data;
+
+    if (ev->timedout) {
+        ngx_stream_log_flush(file, ev->log);
+        return;
+    }
+
+    /* cancel the flush timer for graceful shutdown */
+
+    buffer = file->data;
+    buffer->event = NULL;
+}
+
+
+static ngx_int_t
+ngx_stream_log_aggregate(ngx_stream_session_t *s,
+    ngx_stream_log_aggregate_t *agg)
+{
+    ngx_str_t                         key;
+    ngx_time_t                       *tp;
+    ngx_msec_int_t                    ms;
+    ngx_stream_upstream_t            *u;
+    ngx_stream_log_aggregate_node_t  *node;
+
+    key.data = ngx_pnalloc(s->connection->pool,
+                           ngx_stream_log_ops_len(s, agg->key));
+    if (key.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    key.len = ngx_stream_log_ops_run(s, key.data, agg->key) - key.data;
+
+    if (key.len == 0) {
+        return NGX_OK;
+    }
+
+    node = ngx_log_aggregate_node(&agg->keys, &key);
+    if (node == NULL) {
+        return NGX_ERROR;
+    }
+
+    node->sessions++;
+
+    if (s->status >= 100 && s->status < 600) {
+        node->status[s->status / 100 - 1]++;
+    }
+
+    node->bytes_sent += s->connection->sent;
+    node->bytes_received += s->received;
+
+    tp = ngx_timeofday();
+
+    ms = (ngx_msec_int_t)
+             ((tp->sec - s->start_sec) * 1000 + (tp->msec - s->start_msec));
+    ms = ngx_max(ms, 0);
+
+    node->time += ms;
+
+    if ((ngx_msec_t) ms > node->time_max) {
+        node->time_max = ms;
+    }
+
+    u = s->upstream;
+
+    if (u && u->connected) {
+        node->connect_time += u->connect_time;
+        node->connects++;
+    }
+
+    if (!agg->event->timer_set) {
+        ngx_add_timer(agg->event, agg->interval);
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_stream_log_aggregate_flush_handler(ngx_event_t *ev)
+{
+    u_char                           *buf, *p;
+    size_t                            len;
+    ssize_t                           n;
+    ngx_msec_t                        ms;
+    ngx_queue_t                      *q;
+    ngx_stream_log_aggregate_t       *agg;
+    ngx_stream_log_aggregate_node_t  *node;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_STREAM, ev->log, 0,
+                   "stream log aggregate flush handler");
+
+    /* the counters are also flushed when the timer is cancelled on exit */
+
+    agg = ev->data;
+
+    if (agg->keys.pool == NULL) {
+        return;
+    }
+
+    len = 0;
+
+    for (q = ngx_queue_head(&agg->keys.queue);
+         q != ngx_queue_sentinel(&agg->keys.queue);
+         q = ngx_queue_next(q))
+    {
+        node = ngx_queue_data(q, ngx_stream_log_aggregate_node_t, key.queue);
+
+        len += ngx_cached_http_log_time.len + 1 + node->key.sn.str.len
+               + sizeof(" sessions= 1xx= 2xx= 3xx= 4xx= 5xx= bytes_sent="
+                        " bytes_received= session_time= session_time_max="
+                        " upstream_connect_time=") - 1
+               + 6 * NGX_INT_T_LEN + 2 * NGX_OFF_T_LEN
+               + 3 * (NGX_TIME_T_LEN + 4) + NGX_LINEFEED_SIZE;
+    }
+
+    buf = ngx_pnalloc(agg->keys.pool, len);
+    if (buf == NULL) {
+        goto done;
+    }
+
+    p = buf;
+
+    for (q = ngx_queue_head(&agg->keys.queue);
+         q != ngx_queue_sentinel(&agg->keys.queue);
+         q = ngx_queue_next(q))
+    {
+        node = ngx_queue_data(q, ngx_stream_log_aggregate_node_t, key.queue);
+
+        /* the average time to connect to an upstream */
+
+        ms = node->connects ? node->connect_time / node->connects : 0;
+
+        p = ngx_cpymem(p, ngx_cached_http_log_time.data,
+                       ngx_cached_http_log_time.len);
+        *p++ = ' ';
+
+        p = ngx_cpymem(p, node->key.sn.str.data, node->key.sn.str.len);
+
+        p = ngx_sprintf(p, " sessions=%ui 1xx=%ui 2xx=%ui 3xx=%ui 4xx=%ui"
+                        " 5xx=%ui bytes_sent=%O bytes_received=%O"
+                        " session_time=%T.%03M session_time_max=%T.%03M"
+                        " upstream_connect_time=%T.%03M",
+                        node->sessions, node->status[0], node->status[1],
+                        node->status[2], node->status[3], node->status[4],
+                        node->bytes_sent, node->bytes_received,
+                        (time_t) node->time / 1000, node->time % 1000,
+                        (time_t) node->time_max / 1000,
+                        node->time_max % 1000,
+                        (time_t) ms / 1000, ms % 1000);
+
+        ngx_linefeed(p);
+    }
+
+    len = p - buf;
+
+    n = ngx_write_fd(agg->file->fd, buf, len);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
+                      ngx_write_fd_n " to \"%s\" failed",
+                      agg->file->name.data);
+
+    } else if ((size_t) n != len) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
+                      ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                      agg->file->name.data, n, len);
+    }
+
+done:
+
+    ngx_log_aggregate_reset(&agg->keys);
+}
+
+
+static size_t
+ngx_stream_log_ops_len(ngx_stream_session_t *s, ngx_array_t *ops)
+{
+    size_t                len;
+    ngx_uint_t            i;
+    ngx_stream_log_op_t  *op;
+
+    len = 0;
+    op = ops->elts;
+
+    for (i = 0; i < ops->nelts; i++) {
+        if (op[i].len == 0) {
+            len += op[i].getlen(s, op[i].data);
+
+        } else {
+            len += op[i].len;
+        }
+    }
+
+    return len;
+}
+
+
+static u_char *
+ngx_stream_log_ops_run(ngx_stream_session_t *s, u_char *buf, ngx_array_t *ops)
+{
+    ngx_uint_t            i;
+    ngx_stream_log_op_t  *op;
+
+    op = ops->elts;
+
+    for (i = 0; i < ops->nelts; i++) {
+        buf = op[i].run(s, buf, &op[i]);
+    }
+
+    return buf;
+}
+
+
+static u_char *
+ngx_stream_log_copy_short(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    size_t     len;
+    uintptr_t  data;
+
+    len = op->len;
+    data = op->data;
+
+    while (len--) {
+        *buf++ = (u_char) (data & 0xff);
+        data >>= 8;
+    }
+
+    return buf;
+}
+
+
+static u_char *
+ngx_stream_log_copy_long(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_cpymem(buf, (u_char *) op->data, op->len);
+}
+
+
+static in_port_t
+ngx_stream_log_sockaddr_port(struct sockaddr *sa)
+{
+    struct sockaddr_in   *sin;
+#if (NGX_HAVE_INET6)
+    struct sockaddr_in6  *sin6;
+#endif
+
+    switch (sa->sa_family) {
+
+#if (NGX_HAVE_INET6)
+    case AF_INET6:
+        sin6 = (struct sockaddr_in6 *) sa;
+        return ntohs(sin6->sin6_port);
+#endif
+
+#if (NGX_HAVE_UNIX_DOMAIN)
+    case AF_UNIX:
+        return 0;
+#endif
+
+    default: /* AF_INET */
+        sin = (struct sockaddr_in *) sa;
+        return ntohs(sin->sin_port);
+    }
+}
+
+
+static size_t
+ngx_stream_log_remote_addr_getlen(ngx_stream_session_t *s, uintptr_t data)
+{
+    return s->connection->addr_text.len;
+}
+
+
+static u_char *
+ngx_stream_log_remote_addr(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_cpymem(buf, s->connection->addr_text.data,
+                      s->connection->addr_text.len);
+}
+
+
+static u_char *
+ngx_stream_log_remote_port(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    in_port_t  port;
+
+    port = ngx_stream_log_sockaddr_port(s->connection->sockaddr);
+
+    if (port == 0) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    return ngx_sprintf(buf, "%ui", (ngx_uint_t) port);
+}
+
+
+static u_char *
+ngx_stream_log_server_addr(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    ngx_str_t  str;
+
+    str.len = NGX_SOCKADDR_STRLEN;
+    str.data = buf;
+
+    if (ngx_connection_local_sockaddr(s->connection, &str, 0) != NGX_OK) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    return buf + str.len;
+}
+
+
+static u_char *
+ngx_stream_log_server_port(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    in_port_t  port;
+
+    if (ngx_connection_local_sockaddr(s->connection, NULL, 0) != NGX_OK) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    port = ngx_stream_log_sockaddr_port(s->connection->local_sockaddr);
+
+    if (port == 0) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    return ngx_sprintf(buf, "%ui", (ngx_uint_t) port);
+}
+
+
+static u_char *
+ngx_stream_log_protocol(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_cpymem(buf, s->connection->type == SOCK_DGRAM ? "UDP" : "TCP",
+                      sizeof("TCP") - 1);
+}
+
+
+static u_char *
+ngx_stream_log_connection(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_sprintf(buf, "%uA", s->connection->number);
+}
+
+
+static u_char *
+ngx_stream_log_pid(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_sprintf(buf, "%P", ngx_pid);
+}
+
+
+static u_char *
+ngx_stream_log_time(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_cpymem(buf, ngx_cached_http_log_time.data,
+                      ngx_cached_http_log_time.len);
+}
+
+
+static u_char *
+ngx_stream_log_iso8601(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_cpymem(buf, ngx_cached_http_log_iso8601.data,
+                      ngx_cached_http_log_iso8601.len);
+}
+
+
+static u_char *
+ngx_stream_log_msec(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    ngx_time_t  *tp;
+
+    tp = ngx_timeofday();
+
+    return ngx_sprintf(buf, "%T.%03M", tp->sec, tp->msec);
+}
+
+
+static u_char *
+ngx_stream_log_session_time(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    ngx_time_t      *tp;
+    ngx_msec_int_t   ms;
+
+    tp = ngx_timeofday();
+
+    ms = (ngx_msec_int_t)
+             ((tp->sec - s->start_sec) * 1000 + (tp->msec - s->start_msec));
+    ms = ngx_max(ms, 0);
+
+    return ngx_sprintf(buf, "%T.%03M", (time_t) ms / 1000, ms % 1000);
+}
+
+
+static u_char *
+ngx_stream_log_status(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_sprintf(buf, "%03ui", s->status);
+}
+
+
+static u_char *
+ngx_stream_log_bytes_sent(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_sprintf(buf, "%O", s->connection->sent);
+}
+
+
+static u_char *
+ngx_stream_log_bytes_received(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    return ngx_sprintf(buf, "%O", s->received);
+}
+
+
+static size_t
+ngx_stream_log_upstream_addr_getlen(ngx_stream_session_t *s, uintptr_t data)
+{
+    if (s->upstream == NULL || s->upstream->peer.name == NULL) {
+        return 1;
+    }
+
+    return s->upstream->peer.name->len;
+}
+
+
+static u_char *
+ngx_stream_log_upstream_addr(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    if (s->upstream == NULL || s->upstream->peer.name == NULL) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    return ngx_cpymem(buf, s->upstream->peer.name->data,
+                      s->upstream->peer.name->len);
+}
+
+
+static u_char *
+ngx_stream_log_upstream_connect_time(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    ngx_msec_t  ms;
+
+    if (s->upstream == NULL || !s->upstream->connected) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    ms = s->upstream->connect_time;
+
+    return ngx_sprintf(buf, "%T.%03M", (time_t) ms / 1000, ms % 1000);
+}
+
+
+static u_char *
+ngx_stream_log_upstream_bytes_sent(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    if (s->upstream == NULL) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    return ngx_sprintf(buf, "%O", s->upstream->sent);
+}
+
+
+static u_char *
+ngx_stream_log_upstream_bytes_received(ngx_stream_session_t *s, u_char *buf,
+    ngx_stream_log_op_t *op)
+{
+    if (s->upstream == NULL) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    return ngx_sprintf(buf, "%O", s->upstream->received);
+}
+
+
+static void *
+ngx_stream_log_create_main_conf(ngx_conf_t *cf)
+{
+    ngx_array_t                  a;
+    ngx_str_t                   *value;
+    ngx_stream_log_fmt_t        *fmt;
+    ngx_stream_log_main_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_stream_log_main_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    if (ngx_array_init(&conf->formats, cf->pool, 4,
+                       sizeof(ngx_stream_log_fmt_t))
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    fmt = ngx_array_push(&conf->formats);
+    if (fmt == NULL) {
+        return NULL;
+    }
+
+    ngx_str_set(&fmt->name, "basic");
+
+    fmt->ops = ngx_array_create(cf->pool, 16, sizeof(ngx_stream_log_op_t));
+    if (fmt->ops == NULL) {
+        return NULL;
+    }
+
+    if (ngx_array_init(&a, cf->pool, 1, sizeof(ngx_str_t)) != NGX_OK) {
+        return NULL;
+    }
+
+    value = ngx_array_push(&a);
+    if (value == NULL) {
+        return NULL;
+    }
+
+    *value = ngx_stream_basic_fmt;
+
+    if (ngx_stream_log_compile_format(cf, fmt->ops, &a, 0) != NGX_CONF_OK) {
+        return NULL;
+    }
+
+    return conf;
+}
+
+
+static void *
+ngx_stream_log_create_srv_conf(ngx_conf_t *cf)
+{
+    ngx_stream_log_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_stream_log_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->logs = NULL;
+     *     conf->aggregates = NULL;
+     *     conf->off = 0;
+     */
+
+    return conf;
+}
+
+
+static char *
+ngx_stream_log_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_stream_log_srv_conf_t *prev = parent;
+    ngx_stream_log_srv_conf_t *conf = child;
+
+    if (conf->aggregates == NULL) {
+        conf->aggregates = prev->aggregates;
+    }
+
+    if (conf->logs || conf->off) {
+        return NGX_CONF_OK;
+    }
+
+    conf->logs = prev->logs;
+    conf->off = prev->off;
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_stream_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_stream_log_srv_conf_t *lscf = conf;
+
+    ssize_t                      size;
+    ngx_int_t                    gzip, sample;
+    ngx_uint_t                   i;
+    ngx_msec_t                   flush;
+    ngx_str_t                   *value, name, s;
+    ngx_stream_log_t            *log;
+    ngx_syslog_peer_t           *peer;
+    ngx_stream_log_buf_t        *buffer;
+    ngx_stream_log_fmt_t        *fmt;
+    ngx_stream_log_main_conf_t  *lmcf;
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        lscf->off = 1;
+        if (cf->args->nelts == 2) {
+            return NGX_CONF_OK;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[2]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (lscf->logs == NULL) {
+        lscf->logs = ngx_array_create(cf->pool, 2, sizeof(ngx_stream_log_t));
+        if (lscf->logs == NULL) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    lmcf = ngx_stream_conf_get_module_main_conf(cf, ngx_stream_log_module);
+
+    log = ngx_array_push(lscf->logs);
+    if (log == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_memzero(log, sizeof(ngx_stream_log_t));
+
+    log->sample = NGX_STREAM_LOG_SAMPLE_ALL;
+
+    if (ngx_strncmp(value[1].data, "syslog:", 7) == 0) {
+
+        peer = ngx_pcalloc(cf->pool, sizeof(ngx_syslog_peer_t));
+        if (peer == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        if (ngx_syslog_process_conf(cf, peer) != NGX_CONF_OK) {
+            return NGX_CONF_ERROR;
+        }
+
+        log->syslog_peer = peer;
+
+    } else {
+        log->file = ngx_conf_open_file(cf->cycle, &value[1]);
+        if (log->file == NULL) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    if (cf->args->nelts >= 3) {
+        name = value[2];
+
+    } else {
+        ngx_str_set(&name, "basic");
+    }
+
+    fmt = lmcf->formats.elts;
+    for (i = 0; i < lmcf->formats.nelts; i++) {
+        if (fmt[i].name.len == name.len
+            && ngx_strcasecmp(fmt[i].name.data, name.data) == 0)
+        {
+            log->format = &fmt[i];
+            break;
+        }
+    }
+
+    if (log->format == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "unknown log format \"%V\"", &name);
+        return NGX_CONF_ERROR;
+    }
+
+    size = 0;
+    flush = 0;
+    gzip = 0;
+
+    for (i = 3; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "buffer=", 7) == 0) {
+            s.len = value[i].len - 7;
+            s.data = value[i].data + 7;
+
+            size = ngx_parse_size(&s);
+
+            if (size == NGX_ERROR || size == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid buffer size \"%V\"", &s);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "flush=", 6) == 0) {
+            s.len = value[i].len - 6;
+            s.data = value[i].data + 6;
+
+            flush = ngx_parse_time(&s, 0);
+
+            if (flush == (ngx_msec_t) NGX_ERROR || flush == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid flush time \"%V\"", &s);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "gzip", 4) == 0
+            && (value[i].len == 4 || value[i].data[4] == '='))
+        {
+#if (NGX_ZLIB)
+            if (size == 0) {
+                size = 64 * 1024;
+            }
+
+            if (value[i].len == 4) {
+                gzip = Z_BEST_SPEED;
+                continue;
+            }
+
+            s.len = value[i].len - 5;
+            s.data = value[i].data + 5;
+
+            gzip = ngx_atoi(s.data, s.len);
+
+            if (gzip < 1 || gzip > 9) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid compression level \"%V\"", &s);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "nginx was built without zlib support");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
+        if (ngx_strncmp(value[i].data, "sample=", 7) == 0) {
+            s.len = value[i].len - 7;
+            s.data = value[i].data + 7;
+
+            if (s.len < 2 || s.data[s.len - 1] != '%') {
+                goto invalid_sample;
+            }
+
+            sample = ngx_atofp(s.data, s.len - 1, 2);
+
+            if (sample == NGX_ERROR || sample > NGX_STREAM_LOG_SAMPLE_ALL) {
+                goto invalid_sample;
+            }
+
+            log->sample = sample;
+
+            continue;
+
+        invalid_sample:
+
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid sample rate \"%V\"", &s);
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (flush && size == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "no buffer is defined for access_log \"%V\"",
+                           &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (size) {
+
+        if (log->syslog_peer) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "logs to syslog cannot be buffered");
+            return NGX_CONF_ERROR;
+        }
+
+        if (log->file->data) {
+            buffer = log->file->data;
+
+            if (buffer->last - buffer->start != size
+                || buffer->flush != flush
+                || buffer->gzip != gzip)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "access_log \"%V\" already defined "
+                                   "with conflicting parameters",
+                                   &value[1]);
+                return NGX_CONF_ERROR;
+            }
+
+            return NGX_CONF_OK;
+        }
+
+        buffer = ngx_pcalloc(cf->pool, sizeof(ngx_stream_log_buf_t));
+        if (buffer == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        buffer->start = ngx_pnalloc(cf->pool, size);
+        if (buffer->start == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        buffer->pos = buffer->start;
+        buffer->last = buffer->start + size;
+
+        if (flush) {
+            buffer->event = ngx_pcalloc(cf->pool, sizeof(ngx_event_t));
+            if (buffer->event == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            buffer->event->data = log->file;
+            buffer->event->handler = ngx_stream_log_flush_handler;
+            buffer->event->log = &cf->cycle->new_log;
+            buffer->event->cancelable = 1;
+
+            buffer->flush = flush;
+        }
+
+        buffer->gzip = gzip;
+
+        log->file->flush = ngx_stream_log_flush;
+        log->file->data = buffer;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_stream_log_set_format(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_stream_log_main_conf_t *lmcf = conf;
+
+    ngx_str_t             *value;
+    ngx_uint_t             i;
+    ngx_stream_log_fmt_t  *fmt;
+
+    value = cf->args->elts;
+
+    fmt = lmcf->formats.elts;
+    for (i = 0; i < lmcf->formats.nelts; i++) {
+        if (fmt[i].name.len == value[1].len
+            && ngx_strcmp(fmt[i].name.data, value[1].data) == 0)
+        {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "duplicate \"log_format\" name \"%V\"",
+                               &value[1]);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    fmt = ngx_array_push(&lmcf->formats);
+    if (fmt == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    fmt->name = value[1];
+
+    fmt->ops = ngx_array_create(cf->pool, 16, sizeof(ngx_stream_log_op_t));
+    if (fmt->ops == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    return ngx_stream_log_compile_format(cf, fmt->ops, cf->args, 2);
+}
+
+
+/*
+ * there are no stream variables, so a format is compiled
+ * into the operations of the built-in log variables only
+ */
+
+static char *
+ngx_stream_log_compile_format(ngx_conf_t *cf, ngx_array_t *ops,
+    ngx_array_t *args, ngx_uint_t s)
+{
+    u_char                *data, *p, ch;
+    size_t                 i, len;
+    ngx_str_t             *value, var;
+    ngx_uint_t             bracket;
+    ngx_stream_log_op_t   *op;
+    ngx_stream_log_var_t  *v;
+
+    value = args->elts;
+
+    for ( /* void */ ; s < args->nelts; s++) {
+
+        i = 0;
+
+        while (i < value[s].len) {
+
+            op = ngx_array_push(ops);
+            if (op == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            data = &value[s].data[i];
+
+            if (value[s].data[i] == '$') {
+
+                if (++i == value[s].len) {
+                    goto invalid;
+                }
+
+                if (value[s].data[i] == '{') {
+                    bracket = 1;
+
+                    if (++i == value[s].len) {
+                        goto invalid;
+                    }
+
+                    var.data = &value[s].data[i];
+
+                } else {
+                    bracket = 0;
+                    var.data = &value[s].data[i];
+                }
+
+                for (var.len = 0; i < value[s].len; i++, var.len++) {
+                    ch = value[s].data[i];
+
+                    if (ch == '}' && bracket) {
+                        i++;
+                        bracket = 0;
+                        break;
+                    }
+
+                    if ((ch >= 'A' && ch <= 'Z')
+                        || (ch >= 'a' && ch <= 'z')
+                        || (ch >= '0' && ch <= '9')
+                        || ch == '_')
+                    {
+                        continue;
+                    }
+
+                    break;
+                }
+
+                if (bracket) {
+                    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                       "the closing bracket in \"%V\" "
+                                       "variable is missing", &var);
+                    return NGX_CONF_ERROR;
+                }
+
+                if (var.len == 0) {
+                    goto invalid;
+                }
+
+                for (v = ngx_stream_log_vars; v->name.len; v++) {
+
+                    if (v->name.len == var.len
+                        && ngx_strncmp(v->name.data, var.data, var.len) == 0)
+                    {
+                        op->len = v->len;
+                        op->getlen = v->getlen;
+                        op->run = v->run;
+                        op->data = 0;
+
+                        goto found;
+                    }
+                }
+
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "unknown \"%V\" variable", &var);
+                return NGX_CONF_ERROR;
+
+            found:
+
+                continue;
+            }
+
+            i++;
+
+            while (i < value[s].len && value[s].data[i] != '$') {
+                i++;
+            }
+
+            len = &value[s].data[i] - data;
+
+            if (len) {
+
+                op->len = len;
+                op->getlen = NULL;
+
+                if (len <= sizeof(uintptr_t)) {
+                    op->run = ngx_stream_log_copy_short;
+                    op->data = 0;
+
+                    while (len--) {
+                        op->data <<= 8;
+                        op->data |= data[len];
+                    }
+
+                } else {
+                    op->run = ngx_stream_log_copy_long;
+
+                    p = ngx_pnalloc(cf->pool, len);
+                    if (p == NULL) {
+                        return NGX_CONF_ERROR;
+                    }
+
+                    ngx_memcpy(p, data, len);
+                    op->data = (uintptr_t) p;
+                }
+            }
+        }
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%s\"", data);
+
+    return NGX_CONF_ERROR;
+}
+
+
+static char *
+ngx_stream_log_set_aggregate(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_stream_log_srv_conf_t *lscf = conf;
+
+    ngx_str_t                    *value, s;
+    ngx_uint_t                    i;
+    ngx_array_t                   a;
+    ngx_stream_log_aggregate_t   *agg, **aggp;
+
+    value = cf->args->elts;
+
+    if (lscf->aggregates == NULL) {
+        lscf->aggregates = ngx_array_create(cf->pool, 1,
+                                        sizeof(ngx_stream_log_aggregate_t *));
+        if (lscf->aggregates == NULL) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    agg = ngx_pcalloc(cf->pool, sizeof(ngx_stream_log_aggregate_t));
+    if (agg == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    aggp = ngx_array_push(lscf->aggregates);
+    if (aggp == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    *aggp = agg;
+
+    agg->file = ngx_conf_open_file(cf->cycle, &value[1]);
+    if (agg->file == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    agg->key = ngx_array_create(cf->pool, 4, sizeof(ngx_stream_log_op_t));
+    if (agg->key == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    a.elts = &value[2];
+    a.nelts = 1;
+
+    if (ngx_stream_log_compile_format(cf, agg->key, &a, 0) != NGX_CONF_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    agg->interval = 60000;
+    agg->keys.max_keys = NGX_LOG_AGGREGATE_KEYS;
+    agg->keys.size = sizeof(ngx_stream_log_aggregate_node_t);
+
+    for (i = 3; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "interval=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            agg->interval = ngx_parse_time(&s, 0);
+
+            if (agg->interval == (ngx_msec_t) NGX_ERROR
+                || agg->interval == 0)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid interval \"%V\"", &s);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "keys=", 5) == 0) {
+
+            agg->keys.max_keys = ngx_atoi(value[i].data + 5,
+                                          value[i].len - 5);
+
+            if (agg->keys.max_keys == (ngx_uint_t) NGX_ERROR
+                || agg->keys.max_keys == 0)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid number of keys \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    agg->event = ngx_pcalloc(cf->pool, sizeof(ngx_event_t));
+    if (agg->event == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    agg->event->data = agg;
+    agg->event->handler = ngx_stream_log_aggregate_flush_handler;
+    agg->event->log = &cf->cycle->new_log;
+    agg->event->cancelable = 1;
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_stream_log_init(ngx_conf_t *cf)
+{
+    ngx_stream_core_main_conf_t  *cmcf;
+
+    cmcf = ngx_stream_conf_get_module_main_conf(cf, ngx_stream_core_module);
+    cmcf->log_handler = ngx_stream_log_handler;
+
+    return NGX_OK;
+}
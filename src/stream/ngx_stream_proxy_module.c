@@ -20,9 +20,11 @@ typedef struct {
     size_t                           buffer_size;
     size_t                           upload_rate;
     size_t                           download_rate;
+    ngx_uint_t                       responses;
     ngx_uint_t                       next_upstream_tries;
     ngx_flag_t                       next_upstream;
     ngx_flag_t                       proxy_protocol;
+    ngx_flag_t                       splice;
     ngx_addr_t                      *local;
 
 #if (NGX_STREAM_SSL)
@@ -60,7 +62,7 @@ static ngx_int_t ngx_stream_proxy_test_connect(ngx_connection_t *c);
 static ngx_int_t ngx_stream_proxy_process(ngx_stream_session_t *s,
     ngx_uint_t from_upstream, ngx_uint_t do_write);
 static void ngx_stream_proxy_next_upstream(ngx_stream_session_t *s);
-static void ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_int_t rc);
+static void ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_uint_t rc);
 static u_char *ngx_stream_proxy_log_error(ngx_log_t *log, u_char *buf,
     size_t len);
 
@@ -73,6 +75,17 @@ static char *ngx_stream_proxy_bind(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static ngx_int_t ngx_stream_proxy_send_proxy_protocol(ngx_stream_session_t *s);
 
+#if (NGX_HAVE_SPLICE)
+static ngx_int_t ngx_stream_proxy_init_splice(ngx_stream_session_t *s);
+static ngx_stream_upstream_pipe_t *ngx_stream_proxy_create_pipe(
+    ngx_connection_t *c, size_t size);
+static void ngx_stream_proxy_close_pipe(void *data);
+static ssize_t ngx_stream_proxy_splice_read(ngx_connection_t *src,
+    ngx_stream_upstream_pipe_t *p);
+static ssize_t ngx_stream_proxy_splice_write(ngx_connection_t *dst,
+    ngx_stream_upstream_pipe_t *p);
+#endif
+
 #if (NGX_STREAM_SSL)
 
 static char *ngx_stream_proxy_ssl_password_file(ngx_conf_t *cf,
@@ -135,6 +148,13 @@ static ngx_command_t  ngx_stream_proxy_commands[] = {
       offsetof(ngx_stream_proxy_srv_conf_t, timeout),
       NULL },
 
+    { ngx_string("proxy_responses"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_proxy_srv_conf_t, responses),
+      NULL },
+
     { ngx_string("proxy_buffer_size"),
       NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_size_slot,
@@ -198,6 +218,13 @@ static ngx_command_t  ngx_stream_proxy_commands[] = {
       offsetof(ngx_stream_proxy_srv_conf_t, proxy_protocol),
       NULL },
 
+    { ngx_string("proxy_splice"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_proxy_srv_conf_t, splice),
+      NULL },
+
 #if (NGX_STREAM_SSL)
 
     { ngx_string("proxy_ssl"),
@@ -342,7 +369,7 @@ ngx_stream_proxy_handler(ngx_stream_session_t *s)
 
     u = ngx_pcalloc(c->pool, sizeof(ngx_stream_upstream_t));
     if (u == NULL) {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
@@ -354,11 +381,12 @@ ngx_stream_proxy_handler(ngx_stream_session_t *s)
     u->peer.log_error = NGX_ERROR_ERR;
 
     u->peer.local = pscf->local;
+    u->peer.type = c->type;
 
     uscf = pscf->upstream;
 
     if (uscf->peer.init(s, uscf) != NGX_OK) {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
@@ -370,12 +398,12 @@ ngx_stream_proxy_handler(ngx_stream_session_t *s)
         u->peer.tries = pscf->next_upstream_tries;
     }
 
-    u->proxy_protocol = pscf->proxy_protocol;
+    u->proxy_protocol = (c->type == SOCK_STREAM) ? pscf->proxy_protocol : 0;
     u->start_sec = ngx_time();
 
     p = ngx_pnalloc(c->pool, pscf->buffer_size);
     if (p == NULL) {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
@@ -401,7 +429,7 @@ ngx_stream_proxy_handler(ngx_stream_session_t *s)
         p = ngx_proxy_protocol_write(c, u->downstream_buf.last,
                                      u->downstream_buf.end);
         if (p == NULL) {
-            ngx_stream_proxy_finalize(s, NGX_ERROR);
+            ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return;
         }
 
@@ -431,6 +459,8 @@ ngx_stream_proxy_connect(ngx_stream_session_t *s)
 
     u = s->upstream;
 
+    u->connect_start = ngx_current_msec;
+
     rc = ngx_event_connect_peer(&u->peer);
 
     ngx_log_debug1(NGX_LOG_DEBUG_STREAM, c->log, 0, "proxy connect: %i", rc);
@@ -438,13 +468,13 @@ ngx_stream_proxy_connect(ngx_stream_session_t *s)
     pscf = ngx_stream_get_module_srv_conf(s, ngx_stream_proxy_module);
 
     if (rc == NGX_ERROR) {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
     if (rc == NGX_BUSY) {
         ngx_log_error(NGX_LOG_ERR, c->log, 0, "no live upstreams");
-        ngx_stream_proxy_finalize(s, NGX_DECLINED);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_BAD_GATEWAY);
         return;
     }
 
@@ -491,7 +521,10 @@ ngx_stream_proxy_init_upstream(ngx_stream_session_t *s)
 
     cscf = ngx_stream_get_module_srv_conf(s, ngx_stream_core_module);
 
-    if (cscf->tcp_nodelay && pc->tcp_nodelay == NGX_TCP_NODELAY_UNSET) {
+    if (pc->type == SOCK_STREAM
+        && cscf->tcp_nodelay
+        && pc->tcp_nodelay == NGX_TCP_NODELAY_UNSET)
+    {
         ngx_log_debug0(NGX_LOG_DEBUG_STREAM, pc->log, 0, "tcp_nodelay");
 
         tcp_nodelay = 1;
@@ -547,9 +580,15 @@ ngx_stream_proxy_init_upstream(ngx_stream_session_t *s)
 
     c->log->action = "proxying connection";
 
+#if (NGX_HAVE_SPLICE)
+    if (ngx_stream_proxy_init_splice(s) == NGX_OK) {
+        goto connected;
+    }
+#endif
+
     p = ngx_pnalloc(c->pool, pscf->buffer_size);
     if (p == NULL) {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
@@ -558,6 +597,11 @@ ngx_stream_proxy_init_upstream(ngx_stream_session_t *s)
     u->upstream_buf.pos = p;
     u->upstream_buf.last = p;
 
+#if (NGX_HAVE_SPLICE)
+connected:
+#endif
+
+    u->connect_time = ngx_current_msec - u->connect_start;
     u->connected = 1;
 
     pc->read->handler = ngx_stream_proxy_upstream_handler;
@@ -588,7 +632,7 @@ ngx_stream_proxy_send_proxy_protocol(ngx_stream_session_t *s)
 
     p = ngx_proxy_protocol_write(c, buf, buf + NGX_PROXY_PROTOCOL_MAX_HEADER);
     if (p == NULL) {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return NGX_ERROR;
     }
 
@@ -602,7 +646,7 @@ ngx_stream_proxy_send_proxy_protocol(ngx_stream_session_t *s)
 
     if (n == NGX_AGAIN) {
         if (ngx_handle_write_event(pc->write, 0) != NGX_OK) {
-            ngx_stream_proxy_finalize(s, NGX_ERROR);
+            ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return NGX_ERROR;
         }
 
@@ -616,7 +660,7 @@ ngx_stream_proxy_send_proxy_protocol(ngx_stream_session_t *s)
     }
 
     if (n == NGX_ERROR) {
-        ngx_stream_proxy_finalize(s, NGX_DECLINED);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_BAD_GATEWAY);
         return NGX_ERROR;
     }
 
@@ -632,7 +676,7 @@ ngx_stream_proxy_send_proxy_protocol(ngx_stream_session_t *s)
         ngx_log_error(NGX_LOG_ERR, c->log, 0,
                       "could not send PROXY protocol header at once");
 
-        ngx_stream_proxy_finalize(s, NGX_DECLINED);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_BAD_GATEWAY);
 
         return NGX_ERROR;
     }
@@ -641,6 +685,213 @@ ngx_stream_proxy_send_proxy_protocol(ngx_stream_session_t *s)
 }
 
 
+#if (NGX_HAVE_SPLICE)
+
+static ngx_int_t
+ngx_stream_proxy_init_splice(ngx_stream_session_t *s)
+{
+    ngx_connection_t             *c, *pc;
+    ngx_stream_upstream_t        *u;
+    ngx_stream_proxy_srv_conf_t  *pscf;
+
+    pscf = ngx_stream_get_module_srv_conf(s, ngx_stream_proxy_module);
+
+    c = s->connection;
+    u = s->upstream;
+    pc = u->peer.connection;
+
+    /* rate limiting, PROXY protocol and SSL need the data in user space */
+
+    if (!pscf->splice
+        || c->type != SOCK_STREAM
+        || pscf->upload_rate
+        || pscf->download_rate
+        || pscf->proxy_protocol)
+    {
+        return NGX_DECLINED;
+    }
+
+#if (NGX_SSL)
+    if (c->ssl || pc->ssl) {
+        return NGX_DECLINED;
+    }
+#endif
+
+    u->downstream_pipe = ngx_stream_proxy_create_pipe(c, pscf->buffer_size);
+    if (u->downstream_pipe == NULL) {
+        return NGX_DECLINED;
+    }
+
+    u->upstream_pipe = ngx_stream_proxy_create_pipe(c, pscf->buffer_size);
+    if (u->upstream_pipe == NULL) {
+        u->downstream_pipe = NULL;
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                   "stream proxy splice, pipe size:%uz/%uz",
+                   u->downstream_pipe->capacity, u->upstream_pipe->capacity);
+
+    return NGX_OK;
+}
+
+
+static ngx_stream_upstream_pipe_t *
+ngx_stream_proxy_create_pipe(ngx_connection_t *c, size_t size)
+{
+#ifdef F_SETPIPE_SZ
+    int                          n;
+#endif
+    ngx_pool_cleanup_t          *cln;
+    ngx_stream_upstream_pipe_t  *p;
+
+    cln = ngx_pool_cleanup_add(c->pool, sizeof(ngx_stream_upstream_pipe_t));
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    p = cln->data;
+
+    if (pipe2(p->fd, O_NONBLOCK) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, ngx_errno, "pipe2() failed");
+        return NULL;
+    }
+
+    cln->handler = ngx_stream_proxy_close_pipe;
+
+    p->size = 0;
+    p->capacity = 65536;
+
+#ifdef F_SETPIPE_SZ
+    n = fcntl(p->fd[1], F_SETPIPE_SZ, (int) size);
+
+    if (n == -1) {
+        ngx_log_debug1(NGX_LOG_DEBUG_STREAM, c->log, ngx_errno,
+                       "fcntl(F_SETPIPE_SZ, %uz) failed", size);
+
+        n = fcntl(p->fd[1], F_GETPIPE_SZ);
+    }
+
+    if (n > 0) {
+        p->capacity = n;
+    }
+#endif
+
+    return p;
+}
+
+
+static void
+ngx_stream_proxy_close_pipe(void *data)
+{
+    ngx_stream_upstream_pipe_t  *p = data;
+
+    (void) close(p->fd[0]);
+    (void) close(p->fd[1]);
+}
+
+
+static ssize_t
+ngx_stream_proxy_splice_read(ngx_connection_t *src,
+    ngx_stream_upstream_pipe_t *p)
+{
+    ssize_t       n;
+    ngx_err_t     err;
+    ngx_event_t  *rev;
+
+    rev = src->read;
+
+    n = splice(src->fd, NULL, p->fd[1], NULL, p->capacity - p->size,
+               SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_STREAM, src->log, 0,
+                   "splice read: %z of %uz, pipe:%uz",
+                   n, p->capacity - p->size, p->size);
+
+    if (n > 0) {
+        p->size += n;
+        return n;
+    }
+
+    if (n == 0) {
+        rev->ready = 0;
+        rev->eof = 1;
+        return 0;
+    }
+
+    err = ngx_socket_errno;
+
+    if (err == NGX_EAGAIN) {
+
+        /*
+         * EAGAIN is also returned when the pipe is full,
+         * the socket is known to be drained only if the pipe is empty
+         */
+
+        if (p->size == 0) {
+            rev->ready = 0;
+        }
+
+        return NGX_AGAIN;
+    }
+
+    if (err == NGX_EINTR) {
+        return NGX_AGAIN;
+    }
+
+    rev->ready = 0;
+    rev->error = 1;
+
+    ngx_connection_error(src, err, "splice() failed");
+
+    return NGX_ERROR;
+}
+
+
+static ssize_t
+ngx_stream_proxy_splice_write(ngx_connection_t *dst,
+    ngx_stream_upstream_pipe_t *p)
+{
+    ssize_t       n;
+    ngx_err_t     err;
+    ngx_event_t  *wev;
+
+    wev = dst->write;
+
+    n = splice(p->fd[0], NULL, dst->fd, NULL, p->size,
+               SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_STREAM, dst->log, 0,
+                   "splice write: %z of %uz", n, p->size);
+
+    if (n >= 0) {
+        if ((size_t) n < p->size) {
+            wev->ready = 0;
+        }
+
+        p->size -= n;
+        dst->sent += n;
+
+        return n;
+    }
+
+    err = ngx_socket_errno;
+
+    if (err == NGX_EAGAIN || err == NGX_EINTR) {
+        wev->ready = 0;
+        return NGX_AGAIN;
+    }
+
+    wev->error = 1;
+
+    ngx_connection_error(dst, err, "splice() failed");
+
+    return NGX_ERROR;
+}
+
+#endif
+
+
 #if (NGX_STREAM_SSL)
 
 static char *
@@ -684,20 +935,20 @@ ngx_stream_proxy_ssl_init_connection(ngx_stream_session_t *s)
     if (ngx_ssl_create_connection(pscf->ssl, pc, NGX_SSL_BUFFER|NGX_SSL_CLIENT)
         != NGX_OK)
     {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return;
     }
 
     if (pscf->ssl_server_name || pscf->ssl_verify) {
         if (ngx_stream_proxy_ssl_name(s) != NGX_OK) {
-            ngx_stream_proxy_finalize(s, NGX_ERROR);
+            ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return;
         }
     }
 
     if (pscf->ssl_session_reuse) {
         if (u->peer.set_session(&u->peer, u->peer.data) != NGX_OK) {
-            ngx_stream_proxy_finalize(s, NGX_ERROR);
+            ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return;
         }
     }
@@ -902,7 +1153,8 @@ ngx_stream_proxy_process_connection(ngx_event_t *ev, ngx_uint_t from_upstream)
 
             if (!ev->ready) {
                 if (ngx_handle_read_event(ev, 0) != NGX_OK) {
-                    ngx_stream_proxy_finalize(s, NGX_ERROR);
+                    ngx_stream_proxy_finalize(s,
+                                         NGX_STREAM_INTERNAL_SERVER_ERROR);
                     return;
                 }
 
@@ -920,8 +1172,17 @@ ngx_stream_proxy_process_connection(ngx_event_t *ev, ngx_uint_t from_upstream)
             }
 
         } else {
+            if (c->type == SOCK_DGRAM) {
+                ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                              "udp session timed out"
+                              ", requests:%ui, responses:%ui",
+                              u->requests, u->responses);
+                ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
+                return;
+            }
+
             ngx_connection_error(c, NGX_ETIMEDOUT, "connection timed out");
-            ngx_stream_proxy_finalize(s, NGX_DECLINED);
+            ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
             return;
         }
 
@@ -931,7 +1192,7 @@ ngx_stream_proxy_process_connection(ngx_event_t *ev, ngx_uint_t from_upstream)
                        "stream connection delayed");
 
         if (ngx_handle_read_event(ev, 0) != NGX_OK) {
-            ngx_stream_proxy_finalize(s, NGX_ERROR);
+            ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         }
 
         return;
@@ -1032,6 +1293,9 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
     ngx_log_handler_pt            handler;
     ngx_stream_upstream_t        *u;
     ngx_stream_proxy_srv_conf_t  *pscf;
+#if (NGX_HAVE_SPLICE)
+    ngx_stream_upstream_pipe_t   *sp;
+#endif
 
     u = s->upstream;
 
@@ -1046,6 +1310,9 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
         b = &u->upstream_buf;
         limit_rate = pscf->download_rate;
         received = &u->received;
+#if (NGX_HAVE_SPLICE)
+        sp = u->upstream_pipe;
+#endif
 
     } else {
         src = c;
@@ -1053,6 +1320,9 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
         b = &u->downstream_buf;
         limit_rate = pscf->upload_rate;
         received = &s->received;
+#if (NGX_HAVE_SPLICE)
+        sp = u->downstream_pipe;
+#endif
     }
 
     for ( ;; ) {
@@ -1066,7 +1336,7 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
                 n = dst->send(dst, b->pos, size);
 
                 if (n == NGX_ERROR) {
-                    ngx_stream_proxy_finalize(s, NGX_DECLINED);
+                    ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
                     return NGX_ERROR;
                 }
 
@@ -1079,10 +1349,57 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
                     }
                 }
             }
+
+#if (NGX_HAVE_SPLICE)
+
+            /* data buffered before splicing was enabled goes first */
+
+            if (sp && sp->size && b->pos == b->last
+                && dst && dst->write->ready)
+            {
+                n = ngx_stream_proxy_splice_write(dst, sp);
+
+                if (n == NGX_ERROR) {
+                    ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
+                    return NGX_ERROR;
+                }
+            }
+#endif
+        }
+
+#if (NGX_HAVE_SPLICE)
+
+        if (sp) {
+
+            if (sp->size < sp->capacity && src->read->ready) {
+
+                n = ngx_stream_proxy_splice_read(src, sp);
+
+                if (n > 0) {
+                    *received += n;
+                    do_write = 1;
+
+                    continue;
+                }
+
+                if (n == NGX_ERROR) {
+                    src->read->eof = 1;
+                }
+            }
+
+            break;
         }
 
+#endif
+
         size = b->end - b->last;
 
+        /* datagrams are relayed one at a time to keep their boundaries */
+
+        if (src->type == SOCK_DGRAM && b->pos != b->last) {
+            size = 0;
+        }
+
         if (size && src->read->ready && !src->read->delayed) {
 
             if (limit_rate) {
@@ -1103,11 +1420,24 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 
             n = src->recv(src, b->last, size);
 
+            if (n == 0 && src->type == SOCK_DGRAM) {
+                continue;
+            }
+
             if (n == NGX_AGAIN || n == 0) {
                 break;
             }
 
             if (n > 0) {
+                if (src->type == SOCK_DGRAM) {
+                    if (from_upstream) {
+                        u->responses++;
+
+                    } else {
+                        u->requests++;
+                    }
+                }
+
                 if (limit_rate) {
                     delay = (ngx_msec_t) (n * 1000 / limit_rate);
 
@@ -1132,7 +1462,20 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
         break;
     }
 
-    if (src->read->eof && (b->pos == b->last || (dst && dst->read->eof))) {
+    size = b->last - b->pos;
+
+#if (NGX_HAVE_SPLICE)
+    if (sp) {
+        size += sp->size;
+    }
+#endif
+
+    /* a udp client cannot get replies after its session is closed */
+
+    if (src->read->eof
+        && (size == 0 || (dst && dst->read->eof)
+            || (!from_upstream && c->type == SOCK_DGRAM)))
+    {
         handler = c->log->handler;
         c->log->handler = NULL;
 
@@ -1145,20 +1488,36 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 
         c->log->handler = handler;
 
-        ngx_stream_proxy_finalize(s, NGX_OK);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
+        return NGX_DONE;
+    }
+
+    if (c->type == SOCK_DGRAM
+        && pscf->responses != NGX_MAX_INT32_VALUE
+        && u->requests
+        && u->responses >= pscf->responses * u->requests
+        && u->downstream_buf.pos == u->downstream_buf.last
+        && u->upstream_buf.pos == u->upstream_buf.last)
+    {
+        ngx_log_error(NGX_LOG_INFO, c->log, 0,
+                      "udp session done"
+                      ", requests:%ui, responses:%ui",
+                      u->requests, u->responses);
+
+        ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
         return NGX_DONE;
     }
 
     flags = src->read->eof ? NGX_CLOSE_EVENT : 0;
 
     if (ngx_handle_read_event(src->read, flags) != NGX_OK) {
-        ngx_stream_proxy_finalize(s, NGX_ERROR);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
         return NGX_ERROR;
     }
 
     if (dst) {
         if (ngx_handle_write_event(dst->write, 0) != NGX_OK) {
-            ngx_stream_proxy_finalize(s, NGX_ERROR);
+            ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
             return NGX_ERROR;
         }
 
@@ -1200,7 +1559,7 @@ ngx_stream_proxy_next_upstream(ngx_stream_session_t *s)
         || !pscf->next_upstream
         || (timeout && ngx_current_msec - u->peer.start_time >= timeout))
     {
-        ngx_stream_proxy_finalize(s, NGX_DECLINED);
+        ngx_stream_proxy_finalize(s, NGX_STREAM_BAD_GATEWAY);
         return;
     }
 
@@ -1228,13 +1587,13 @@ ngx_stream_proxy_next_upstream(ngx_stream_session_t *s)
 
 
 static void
-ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_int_t rc)
+ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_uint_t rc)
 {
     ngx_connection_t       *pc;
     ngx_stream_upstream_t  *u;
 
     ngx_log_debug1(NGX_LOG_DEBUG_STREAM, s->connection->log, 0,
-                   "finalize stream proxy: %i", rc);
+                   "finalize stream proxy: %ui", rc);
 
     u = s->upstream;
 
@@ -1260,13 +1619,15 @@ ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_int_t rc)
         }
 #endif
 
+        u->sent = pc->sent;
+
         ngx_close_connection(pc);
         u->peer.connection = NULL;
     }
 
 noupstream:
 
-    ngx_stream_close_connection(s->connection);
+    ngx_stream_finalize_session(s, rc);
 }
 
 
@@ -1332,9 +1693,11 @@ ngx_stream_proxy_create_srv_conf(ngx_conf_t *cf)
     conf->buffer_size = NGX_CONF_UNSET_SIZE;
     conf->upload_rate = NGX_CONF_UNSET_SIZE;
     conf->download_rate = NGX_CONF_UNSET_SIZE;
+    conf->responses = NGX_CONF_UNSET_UINT;
     conf->next_upstream_tries = NGX_CONF_UNSET_UINT;
     conf->next_upstream = NGX_CONF_UNSET;
     conf->proxy_protocol = NGX_CONF_UNSET;
+    conf->splice = NGX_CONF_UNSET;
     conf->local = NGX_CONF_UNSET_PTR;
 
 #if (NGX_STREAM_SSL)
@@ -1356,6 +1719,12 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_stream_proxy_srv_conf_t *prev = parent;
     ngx_stream_proxy_srv_conf_t *conf = child;
 
+#if (NGX_STREAM_SSL)
+    ngx_uint_t                   i;
+    ngx_stream_listen_t         *ls;
+    ngx_stream_core_main_conf_t *cmcf;
+#endif
+
     ngx_conf_merge_msec_value(conf->connect_timeout,
                               prev->connect_timeout, 60000);
 
@@ -1374,6 +1743,9 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_conf_merge_size_value(conf->download_rate,
                               prev->download_rate, 0);
 
+    ngx_conf_merge_uint_value(conf->responses,
+                              prev->responses, NGX_MAX_INT32_VALUE);
+
     ngx_conf_merge_uint_value(conf->next_upstream_tries,
                               prev->next_upstream_tries, 0);
 
@@ -1381,6 +1753,17 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_value(conf->proxy_protocol, prev->proxy_protocol, 0);
 
+#if !(NGX_HAVE_SPLICE)
+    if (conf->splice == 1) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "\"proxy_splice\" is not supported "
+                           "on this platform, ignored");
+        conf->splice = 0;
+    }
+#endif
+
+    ngx_conf_merge_value(conf->splice, prev->splice, 0);
+
     ngx_conf_merge_ptr_value(conf->local, prev->local, NULL);
 
 #if (NGX_STREAM_SSL)
@@ -1418,6 +1801,24 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
 
     ngx_conf_merge_ptr_value(conf->ssl_passwords, prev->ssl_passwords, NULL);
 
+    if (conf->ssl_enable) {
+        cmcf = ngx_stream_conf_get_module_main_conf(cf,
+                                                    ngx_stream_core_module);
+
+        ls = cmcf->listen.elts;
+        for (i = 0; i < cmcf->listen.nelts; i++) {
+            if (ls[i].type == SOCK_DGRAM
+                && ls[i].ctx->srv_conf[ngx_stream_proxy_module.ctx_index]
+                   == conf)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "\"proxy_ssl\" is incompatible with "
+                                   "\"udp\" listen sockets");
+                return NGX_CONF_ERROR;
+            }
+        }
+    }
+
     if (conf->ssl_enable && ngx_stream_proxy_set_ssl(cf, conf) != NGX_OK) {
         return NGX_CONF_ERROR;
     }
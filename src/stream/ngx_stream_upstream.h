@@ -78,12 +78,32 @@ struct ngx_stream_upstream_srv_conf_s {
 };
 
 
+#if (NGX_HAVE_SPLICE)
+
+typedef struct {
+    int                                fd[2];
+    size_t                             size;
+    size_t                             capacity;
+} ngx_stream_upstream_pipe_t;
+
+#endif
+
+
 typedef struct {
     ngx_peer_connection_t              peer;
     ngx_buf_t                          downstream_buf;
     ngx_buf_t                          upstream_buf;
     off_t                              received;
+    off_t                              sent;
     time_t                             start_sec;
+    ngx_msec_t                         connect_start;
+    ngx_msec_t                         connect_time;
+    ngx_uint_t                         requests;
+    ngx_uint_t                         responses;
+#if (NGX_HAVE_SPLICE)
+    ngx_stream_upstream_pipe_t        *downstream_pipe;
+    ngx_stream_upstream_pipe_t        *upstream_pipe;
+#endif
 #if (NGX_STREAM_SSL)
     ngx_str_t                          ssl_name;
 #endif
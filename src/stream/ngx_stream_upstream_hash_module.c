@@ -23,7 +23,7 @@ typedef struct {
 
 
 typedef struct {
-    ngx_stream_upstream_chash_points_t   *points;
+    ngx_uint_t                            jump;  /* unsigned  jump:1; */
 } ngx_stream_upstream_hash_srv_conf_t;
 
 
@@ -45,6 +45,8 @@ static ngx_int_t ngx_stream_upstream_init_hash_peer(ngx_stream_session_t *s,
     ngx_stream_upstream_srv_conf_t *us);
 static ngx_int_t ngx_stream_upstream_get_hash_peer(ngx_peer_connection_t *pc,
     void *data);
+static ngx_uint_t ngx_stream_upstream_jump_hash(uint64_t key,
+    ngx_uint_t buckets);
 
 static ngx_int_t ngx_stream_upstream_init_chash(ngx_conf_t *cf,
     ngx_stream_upstream_srv_conf_t *us);
@@ -201,12 +203,21 @@ ngx_stream_upstream_get_hash_peer(ngx_peer_connection_t *pc, void *data)
         ngx_crc32_update(&hash, hp->key.data, hp->key.len);
         ngx_crc32_final(hash);
 
-        hash = (hash >> 16) & 0x7fff;
-
-        hp->hash += hash;
         hp->rehash++;
 
-        w = hp->hash % hp->rrp.peers->total_weight;
+        if (hp->conf->jump) {
+            hp->hash = hash;
+            w = ngx_stream_upstream_jump_hash(hash,
+                                              hp->rrp.peers->total_weight);
+
+        } else {
+            hash = (hash >> 16) & 0x7fff;
+
+            hp->hash += hash;
+
+            w = hp->hash % hp->rrp.peers->total_weight;
+        }
+
         peer = hp->rrp.peers->peer;
         p = 0;
 
@@ -267,6 +278,31 @@ ngx_stream_upstream_get_hash_peer(ngx_peer_connection_t *pc, void *data)
 }
 
 
+static ngx_uint_t
+ngx_stream_upstream_jump_hash(uint64_t key, ngx_uint_t buckets)
+{
+    int64_t  b, j;
+
+    /*
+     * Jump consistent hash (Lamping, Veach): maps a key to one of
+     * the buckets with no lookup table, moving only 1/n of keys
+     * when a bucket is added at the end.
+     */
+
+    b = -1;
+    j = 0;
+
+    while (j < (int64_t) buckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (int64_t) ((b + 1) * ((double) (1LL << 31)
+                                  / (double) ((key >> 33) + 1)));
+    }
+
+    return (ngx_uint_t) b;
+}
+
+
 static ngx_int_t
 ngx_stream_upstream_init_chash(ngx_conf_t *cf,
     ngx_stream_upstream_srv_conf_t *us)
@@ -279,7 +315,6 @@ ngx_stream_upstream_init_chash(ngx_conf_t *cf,
     ngx_stream_upstream_rr_peer_t        *peer;
     ngx_stream_upstream_rr_peers_t       *peers;
     ngx_stream_upstream_chash_points_t   *points;
-    ngx_stream_upstream_hash_srv_conf_t  *hcf;
     union {
         uint32_t                          value;
         u_char                            byte[4];
@@ -387,9 +422,15 @@ ngx_stream_upstream_init_chash(ngx_conf_t *cf,
 
     points->number = i + 1;
 
-    hcf = ngx_stream_conf_upstream_srv_conf(us,
-                                            ngx_stream_upstream_hash_module);
-    hcf->points = points;
+    /*
+     * points are built once at configuration time; if the upstream
+     * has a zone they are copied there along with the peers
+     */
+
+    peers->data = points;
+    peers->data_size = sizeof(ngx_stream_upstream_chash_points_t)
+                       + sizeof(ngx_stream_upstream_chash_point_t)
+                         * (points->number - 1);
 
     return NGX_OK;
 }
@@ -452,7 +493,6 @@ ngx_stream_upstream_init_chash_peer(ngx_stream_session_t *s,
     ngx_stream_upstream_srv_conf_t *us)
 {
     uint32_t                               hash;
-    ngx_stream_upstream_hash_srv_conf_t   *hcf;
     ngx_stream_upstream_hash_peer_data_t  *hp;
 
     if (ngx_stream_upstream_init_hash_peer(s, us) != NGX_OK) {
@@ -462,14 +502,12 @@ ngx_stream_upstream_init_chash_peer(ngx_stream_session_t *s,
     s->upstream->peer.get = ngx_stream_upstream_get_chash_peer;
 
     hp = s->upstream->peer.data;
-    hcf = ngx_stream_conf_upstream_srv_conf(us,
-                                            ngx_stream_upstream_hash_module);
 
     hash = ngx_crc32_long(hp->key.data, hp->key.len);
 
     ngx_stream_upstream_rr_peers_rlock(hp->rrp.peers);
 
-    hp->hash = ngx_stream_upstream_find_chash_point(hcf->points, hash);
+    hp->hash = ngx_stream_upstream_find_chash_point(hp->rrp.peers->data, hash);
 
     ngx_stream_upstream_rr_peers_unlock(hp->rrp.peers);
 
@@ -490,7 +528,6 @@ ngx_stream_upstream_get_chash_peer(ngx_peer_connection_t *pc, void *data)
     ngx_stream_upstream_rr_peer_t        *peer, *best;
     ngx_stream_upstream_chash_point_t    *point;
     ngx_stream_upstream_chash_points_t   *points;
-    ngx_stream_upstream_hash_srv_conf_t  *hcf;
 
     ngx_log_debug1(NGX_LOG_DEBUG_STREAM, pc->log, 0,
                    "get consistent hash peer, try: %ui", pc->tries);
@@ -500,9 +537,8 @@ ngx_stream_upstream_get_chash_peer(ngx_peer_connection_t *pc, void *data)
     pc->connection = NULL;
 
     now = ngx_time();
-    hcf = hp->conf;
 
-    points = hcf->points;
+    points = hp->rrp.peers->data;
     point = &points->point[0];
 
     for ( ;; ) {
@@ -606,7 +642,7 @@ ngx_stream_upstream_hash_create_conf(ngx_conf_t *cf)
         return NULL;
     }
 
-    conf->points = NULL;
+    conf->jump = 0;
 
     return conf;
 }
@@ -615,6 +651,8 @@ ngx_stream_upstream_hash_create_conf(ngx_conf_t *cf)
 static char *
 ngx_stream_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
+    ngx_stream_upstream_hash_srv_conf_t *hcf = conf;
+
     ngx_str_t                       *value;
     ngx_stream_upstream_srv_conf_t  *uscf;
 
@@ -640,12 +678,18 @@ ngx_stream_upstream_hash(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
                   |NGX_STREAM_UPSTREAM_FAIL_TIMEOUT
                   |NGX_STREAM_UPSTREAM_DOWN;
 
+    hcf->jump = 0;
+
     if (cf->args->nelts == 2) {
         uscf->peer.init_upstream = ngx_stream_upstream_init_hash;
 
     } else if (ngx_strcmp(value[2].data, "consistent") == 0) {
         uscf->peer.init_upstream = ngx_stream_upstream_init_chash;
 
+    } else if (ngx_strcmp(value[2].data, "jump") == 0) {
+        uscf->peer.init_upstream = ngx_stream_upstream_init_hash;
+        hcf->jump = 1;
+
     } else {
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[2]);
@@ -68,6 +68,9 @@ struct ngx_stream_upstream_rr_peers_s {
 
     ngx_str_t                       *name;
 
+    void                            *data;
+    size_t                           data_size;
+
     ngx_stream_upstream_rr_peers_t  *next;
 
     ngx_stream_upstream_rr_peer_t   *peer;
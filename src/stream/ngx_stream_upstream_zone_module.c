@@ -15,7 +15,7 @@ static char *ngx_stream_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd,
 static ngx_int_t ngx_stream_upstream_init_zone(ngx_shm_zone_t *shm_zone,
     void *data);
 static ngx_stream_upstream_rr_peers_t *ngx_stream_upstream_zone_copy_peers(
-    ngx_slab_pool_t *shpool, ngx_stream_upstream_srv_conf_t *uscf);
+    ngx_shm_zone_t *shm_zone, ngx_stream_upstream_srv_conf_t *uscf);
 
 
 static ngx_command_t  ngx_stream_upstream_zone_commands[] = {
@@ -105,6 +105,11 @@ ngx_stream_upstream_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     uscf->shm_zone->init = ngx_stream_upstream_init_zone;
     uscf->shm_zone->data = umcf;
 
+    /*
+     * "hash ... consistent" keeps its points in the zone as well:
+     * 160 points of 8 bytes per unit of server weight
+     */
+
     uscf->shm_zone->noreuse = 1;
 
     return NGX_CONF_OK;
@@ -164,7 +169,7 @@ ngx_stream_upstream_init_zone(ngx_shm_zone_t *shm_zone, void *data)
             continue;
         }
 
-        peers = ngx_stream_upstream_zone_copy_peers(shpool, uscf);
+        peers = ngx_stream_upstream_zone_copy_peers(shm_zone, uscf);
         if (peers == NULL) {
             return NGX_ERROR;
         }
@@ -178,12 +183,16 @@ ngx_stream_upstream_init_zone(ngx_shm_zone_t *shm_zone, void *data)
 
 
 static ngx_stream_upstream_rr_peers_t *
-ngx_stream_upstream_zone_copy_peers(ngx_slab_pool_t *shpool,
+ngx_stream_upstream_zone_copy_peers(ngx_shm_zone_t *shm_zone,
     ngx_stream_upstream_srv_conf_t *uscf)
 {
+    void                            *data;
+    ngx_slab_pool_t                 *shpool;
     ngx_stream_upstream_rr_peer_t   *peer, **peerp;
     ngx_stream_upstream_rr_peers_t  *peers, *backup;
 
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
     peers = ngx_slab_alloc(shpool, sizeof(ngx_stream_upstream_rr_peers_t));
     if (peers == NULL) {
         return NULL;
@@ -206,6 +215,31 @@ ngx_stream_upstream_zone_copy_peers(ngx_slab_pool_t *shpool,
         *peerp = peer;
     }
 
+    if (peers->data_size) {
+
+        /*
+         * balancer data, e.g. consistent hash points, shared read-only;
+         * the zone is never reused on reload (noreuse), so each cycle
+         * copies the data into a new zone, and the old zone is freed
+         * along with the old cycle
+         */
+
+        data = ngx_slab_alloc(shpool, peers->data_size);
+        if (data == NULL) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "upstream zone \"%V\" is too small "
+                          "for the balancer data of upstream \"%V\", "
+                          "%uz more bytes are needed",
+                          &shm_zone->shm.name, &uscf->host,
+                          peers->data_size);
+            return NULL;
+        }
+
+        ngx_memcpy(data, peers->data, peers->data_size);
+
+        peers->data = data;
+    }
+
     if (peers->next == NULL) {
         goto done;
     }